@@ -0,0 +1,514 @@
+/*
+ * bench-trans.c - Time the registered transpose functions on the host
+ *
+ * Where test-trans counts simulated misses on small matrices, this runs
+ * every function from registerFunctions() natively (trans.c built at
+ * -O2) on matrices of up to 8192x8192, pinned to one CPU, after a
+ * warmup run. Each size is repeated over several trials and the best
+ * one is reported as GB/s (a read and a write per element), cycles per
+ * element, and L1D read and last-level cache misses per element from
+ * perf_event_open. When the counters are not available, for instance
+ * under perf_event_paranoid or in a VM, cycles fall back to the time
+ * stamp counter and the miss columns show "-".
+ *
+ * The multithreaded transpose is run once per thread count given with
+ * -t, so its scaling shows up as rows of the same size. Whenever it
+ * runs with more than one thread, the default being one per CPU,
+ * pinning is left off so the threads can spread over the CPUs.
+ *
+ * With -i only the in-place functions run, on A alone, so that the peak
+ * resident set size printed at the end can be held against that of a
+ * normal run over the same sizes.
+ *
+ * With -e the generic transposes of transgen.h run instead, for the
+ * element sizes given, each result checked with its is_transpose.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "cachelab.h"
+#include "transgen.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_RDTSC 1
+#endif
+
+#define MAXSIZE     8192
+#define MAXSIZES    16
+#define MAXTHREADS  16
+#define MAXELEMS    8
+
+/* External function defined in trans.c */
+extern void registerFunctions();
+
+/* The multithreaded transpose and its thread count, in trans.c */
+extern void trans_par(int M, int N, int A[N][M], int B[M][N]);
+extern int trans_threads;
+extern long trans_par_min;
+
+/* External variables defined in cachelab.c */
+extern trans_func_t func_list[MAX_TRANS_FUNCS];
+extern int func_counter;
+
+enum {
+    EV_CYCLES = 0,
+    EV_L1D,
+    EV_LLC,
+    NEVENTS
+};
+
+static const char* event_names[] = {"cycles", "L1D read misses", "LLC misses"};
+
+/* Transpose A over itself, set by -i */
+static int inplace = 0;
+
+/* One counter per event, -1 if it could not be opened */
+static int events[NEVENTS] = {-1, -1, -1};
+
+static int open_event(unsigned int type, unsigned long long config)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static void open_events(void)
+{
+    events[EV_CYCLES] = open_event(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+    events[EV_L1D] = open_event(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D |
+                                (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+    events[EV_LLC] = open_event(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+    for (int k = 0; k < NEVENTS; k++) {
+        if (events[k] < 0)
+            fprintf(stderr, "perf_event_open: %s not available\n", event_names[k]);
+    }
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static unsigned long long tsc(void)
+{
+#ifdef HAVE_RDTSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+/* What one trial measured */
+struct sample {
+    double seconds;
+    double cycles;
+    long long counts[NEVENTS];
+};
+
+/* When the current trial started */
+static double s0;
+static unsigned long long t0;
+
+static void trial_begin(void)
+{
+    for (int k = 0; k < NEVENTS; k++) {
+        if (events[k] >= 0) {
+            ioctl(events[k], PERF_EVENT_IOC_RESET, 0);
+            ioctl(events[k], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+    s0 = now();
+    t0 = tsc();
+}
+
+static void trial_end(struct sample* out)
+{
+    unsigned long long t1 = tsc();
+    double s1 = now();
+
+    for (int k = 0; k < NEVENTS; k++) {
+        out->counts[k] = -1;
+        if (events[k] >= 0) {
+            ioctl(events[k], PERF_EVENT_IOC_DISABLE, 0);
+            if (read(events[k], &out->counts[k], sizeof(long long)) != sizeof(long long))
+                out->counts[k] = -1;
+        }
+    }
+    out->seconds = s1 - s0;
+    out->cycles = out->counts[EV_CYCLES] >= 0 ? out->counts[EV_CYCLES] : (double)(t1 - t0);
+}
+
+/*
+ * trial - Run func once with the counters on
+ */
+static void trial(int f, int M, int N, int* A, int* B, struct sample* out)
+{
+    trial_begin();
+    (*func_list[f].func_ptr)(M, N, (int (*)[M])A, (int (*)[N])B);
+    trial_end(out);
+}
+
+/* The transgen.h instances, behind one signature */
+#define GENERIC(name, type)                                                   \
+static void run_##name(int M, int N, void* A, void* B)                        \
+{                                                                             \
+    name(M, N, (type (*)[M])A, (type (*)[N])B);                               \
+}                                                                             \
+static int check_##name(int M, int N, void* A, void* B)                       \
+{                                                                             \
+    return name##_is_transpose(M, N, (type (*)[M])A, (type (*)[N])B);         \
+}
+
+GENERIC(transpose_u8, uint8_t)
+GENERIC(transpose_u16, uint16_t)
+GENERIC(transpose_u32, uint32_t)
+GENERIC(transpose_u64, uint64_t)
+GENERIC(transpose_rec16, transgen_rec16_t)
+
+static struct generic {
+    int size;
+    void (*run)(int M, int N, void* A, void* B);
+    int (*check)(int M, int N, void* A, void* B);
+    char* description;
+} generics[] = {
+    {1, run_transpose_u8, check_transpose_u8, "Generic transpose, 8-bit elements"},
+    {2, run_transpose_u16, check_transpose_u16, "Generic transpose, 16-bit elements"},
+    {4, run_transpose_u32, check_transpose_u32, "Generic transpose, 32-bit elements"},
+    {8, run_transpose_u64, check_transpose_u64, "Generic transpose, 64-bit elements"},
+    {16, run_transpose_rec16, check_transpose_rec16, "Generic transpose, 16 byte records"},
+};
+
+#define NGENERICS   (int)(sizeof(generics) / sizeof(generics[0]))
+
+/* What fill() puts at index i of A */
+static inline int element(size_t i)
+{
+    return (int)(i * 2654435761u);
+}
+
+static void fill(int* A, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+        A[i] = element(i);
+}
+
+/*
+ * check - Whether B is the transpose of what fill() put in A, as the
+ *     function saw them; B may be A itself
+ */
+static int check(int M, int N, int* B)
+{
+    for (long i = 0; i < N; i++) {
+        for (long j = 0; j < M; j++) {
+            if (B[j * N + i] != element(i * M + j))
+                return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+ * report - Print one row of the table
+ */
+static void report(char* func, char* size, int threads, size_t bytes, double elems,
+                   struct sample* best, char* description)
+{
+    char l1[16] = "-", llc[16] = "-";
+
+    if (best->counts[EV_L1D] >= 0)
+        snprintf(l1, sizeof(l1), "%.3f", best->counts[EV_L1D] / elems);
+    if (best->counts[EV_LLC] >= 0)
+        snprintf(llc, sizeof(llc), "%.3f", best->counts[EV_LLC] / elems);
+    printf("%-4s %-11s %4d %10.3f %8.2f %10.2f %10s %10s  %s\n", func, size, threads,
+           best->seconds * 1e3, 2.0 * bytes / best->seconds / 1e9,
+           best->cycles / elems, l1, llc, description);
+    fflush(stdout);
+}
+
+/*
+ * bench - Check func f once, then time it and print its best trial
+ */
+static void bench(int f, int M, int N, int* A, int* B, int trials, int threads)
+{
+    size_t bytes = (size_t)M * N * sizeof(int);
+    double elems = (double)M * N;
+    struct sample best, cur;
+    char func[16], size[24];
+
+    // 预热一次, 顺便检查结果
+    snprintf(size, sizeof(size), "%dx%d", M, N);
+    if (inplace)
+        fill(A, (size_t)M * N);
+    else
+        memset(B, 0, bytes);
+    trial(f, M, N, A, B, &best);
+    if (!check(M, N, B)) {
+        printf("%-4d %-11s %4d wrong result, skipped  %s\n", f, size, threads,
+               func_list[f].description);
+        return;
+    }
+    for (int t = 0; t < trials; t++) {
+        if (inplace)
+            fill(A, (size_t)M * N);
+        trial(f, M, N, A, B, &cur);
+        if (t == 0 || cur.seconds < best.seconds)
+            best = cur;
+    }
+
+    snprintf(func, sizeof(func), "%d", f);
+    report(func, size, threads, bytes, elems, &best, func_list[f].description);
+}
+
+/*
+ * bench_generic - The same for the transgen.h instance g
+ */
+static void bench_generic(int g, int M, int N, void* A, void* B, int trials)
+{
+    size_t bytes = (size_t)M * N * generics[g].size;
+    double elems = (double)M * N;
+    struct sample best, cur;
+    char func[16], size[24];
+
+    snprintf(func, sizeof(func), "e%d", generics[g].size);
+    snprintf(size, sizeof(size), "%dx%d", M, N);
+    memset(B, 0, bytes);
+    trial_begin();
+    generics[g].run(M, N, A, B);
+    trial_end(&best);
+    if (!generics[g].check(M, N, A, B)) {
+        printf("%-4s %-11s %4d wrong result, skipped  %s\n", func, size, 1,
+               generics[g].description);
+        return;
+    }
+    for (int t = 0; t < trials; t++) {
+        trial_begin();
+        generics[g].run(M, N, A, B);
+        trial_end(&cur);
+        if (t == 0 || cur.seconds < best.seconds)
+            best = cur;
+    }
+    report(func, size, 1, bytes, elems, &best, generics[g].description);
+}
+
+static void usage(char* argv[])
+{
+    printf("Usage: %s [-h] [-s <sizes>] [-r <trials>] [-c <cpu>] [-F <func>]\n", argv[0]);
+    printf("       [-t <threads>] [-m <elems>] [-i] [-e <bytes>]\n");
+    printf("Options:\n");
+    printf("  -h          Print this help message.\n");
+    printf("  -s <sizes>  Comma separated MxN or square N sizes (default 256,1024,4096,8192),\n");
+    printf("              each dimension at most %d.\n", MAXSIZE);
+    printf("  -r <trials> Timed trials per function and size, best reported (default 5).\n");
+    printf("  -c <cpu>    CPU to pin to (default: the one it starts on).\n");
+    printf("  -F <func>   Only run this registered function.\n");
+    printf("  -i          Only the in-place functions, without a B matrix.\n");
+    printf("  -e <bytes>  Comma separated element sizes (1,2,4,8,16) to run the generic\n");
+    printf("              transposes on, instead of the registered functions; not with -i.\n");
+    printf("  -m <elems>  Smallest M*N the multithreaded transpose tiles (default %ld).\n",
+           trans_par_min);
+    printf("  -t <threads> Comma separated thread counts for the multithreaded\n");
+    printf("              transpose (default: one per online CPU); no pinning.\n");
+    printf("Example: %s -s 61x67,1024x768 -r 10\n", argv[0]);
+    printf("         %s -s 8192 -F 4 -t 1,2,4,8\n", argv[0]);
+    printf("         %s -s 4096 -e 1,2,4,8,16\n", argv[0]);
+}
+
+int main(int argc, char* argv[])
+{
+    char sizelist[256] = "256,1024,4096,8192";
+    int Ms[MAXSIZES], Ns[MAXSIZES], nsizes = 0;
+    int threads[MAXTHREADS], nthreads = 0;
+    int elemsizes[MAXELEMS], nelems = 0;
+    int trials = 5, cpu = -1, only = -1;
+    char* p;
+    int c;
+
+    while ((c = getopt(argc, argv, "s:r:c:F:t:e:m:ih")) != -1) {
+        switch (c) {
+        case 's':
+            strncpy(sizelist, optarg, sizeof(sizelist) - 1);
+            break;
+        case 'r':
+            trials = atoi(optarg);
+            break;
+        case 'c':
+            cpu = atoi(optarg);
+            break;
+        case 'F':
+            only = atoi(optarg);
+            break;
+        case 'm':
+            trans_par_min = atol(optarg);
+            break;
+        case 'i':
+            inplace = 1;
+            break;
+        case 'e':
+            for (p = strtok(optarg, ","); p != NULL && nelems < MAXELEMS; p = strtok(NULL, ",")) {
+                int g;
+                for (g = 0; g < NGENERICS && generics[g].size != atoi(p); g++)
+                    ;
+                if (g == NGENERICS) {
+                    fprintf(stderr, "no generic transpose for %s byte elements\n", p);
+                    exit(1);
+                }
+                elemsizes[nelems++] = g;
+            }
+            break;
+        case 't':
+            for (p = strtok(optarg, ","); p != NULL && nthreads < MAXTHREADS; p = strtok(NULL, ","))
+                threads[nthreads++] = atoi(p);
+            break;
+        case 'h':
+            usage(argv);
+            exit(0);
+        default:
+            usage(argv);
+            exit(1);
+        }
+    }
+
+    for (p = strtok(sizelist, ","); p != NULL && nsizes < MAXSIZES; p = strtok(NULL, ",")) {
+        int m = 0, n = 0;
+        int got = sscanf(p, "%dx%d", &m, &n);
+        if (got == 1)
+            n = m;
+        if (got < 1 || m < 1 || n < 1 || m > MAXSIZE || n > MAXSIZE) {
+            fprintf(stderr, "bad size %s\n", p);
+            exit(1);
+        }
+        Ms[nsizes] = m;
+        Ns[nsizes++] = n;
+    }
+    for (int k = 0; k < nthreads; k++) {
+        if (threads[k] < 1) {
+            usage(argv);
+            exit(1);
+        }
+    }
+    if (nthreads == 0)
+        threads[nthreads++] = 0;
+    if (nsizes == 0 || trials < 1) {
+        usage(argv);
+        exit(1);
+    }
+    if (nelems > 0 && inplace) {
+        fprintf(stderr, "-e and -i cannot be combined, the generic transposes are out of place\n");
+        exit(1);
+    }
+
+    registerFunctions();
+    if (only >= func_counter) {
+        fprintf(stderr, "there are only %d functions\n", func_counter);
+        exit(1);
+    }
+
+    // 多线程转置要跑在多个 CPU 上, 这时不能绑核
+    int parallel = 0;
+    if (nelems == 0 && !inplace && (only < 0 || func_list[only].func_ptr == trans_par)) {
+        for (int r = 0; r < nthreads; r++)
+            parallel |= (threads[r] ? threads[r] : sysconf(_SC_NPROCESSORS_ONLN)) > 1;
+    }
+    if (parallel && cpu >= 0)
+        fprintf(stderr, "-c ignored, the multithreaded transpose runs on all CPUs\n");
+
+    // 固定在一个 CPU 上, 计数器和时间戳才可比
+    if (parallel)
+        cpu = -1;
+    else
+        cpu = cpu < 0 ? sched_getcpu() : cpu;
+    if (cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        if (sched_setaffinity(0, sizeof(set), &set) != 0)
+            perror("sched_setaffinity");
+    }
+    open_events();
+
+    if (cpu >= 0)
+        printf("cpu %d, best of %d trials after a warmup\n", cpu, trials);
+    else
+        printf("not pinned, best of %d trials after a warmup\n", trials);
+    printf("%-4s %-11s %4s %10s %8s %10s %10s %10s  %s\n", "func", "size", "thr", "ms",
+           "GB/s", "cyc/elem", "L1D/elem", "LLC/elem", "description");
+
+    for (int k = 0; k < nsizes && nelems > 0; k++) {
+        for (int e = 0; e < nelems; e++) {
+            int g = elemsizes[e], M = Ms[k], N = Ns[k];
+            size_t bytes = (size_t)M * N * generics[g].size;
+            unsigned char* A;
+            unsigned char* B;
+
+            if (posix_memalign((void**)&A, 4096, bytes) != 0 ||
+                posix_memalign((void**)&B, 4096, bytes) != 0) {
+                fprintf(stderr, "posix_memalign error.\n");
+                exit(1);
+            }
+            for (size_t i = 0; i < bytes; i++)
+                A[i] = element(i);
+            bench_generic(g, M, N, A, B, trials);
+            free(A);
+            free(B);
+        }
+    }
+
+    for (int k = 0; k < nsizes && nelems == 0; k++) {
+        int M = Ms[k], N = Ns[k];
+        size_t bytes = (size_t)M * N * sizeof(int);
+        int* A;
+        int* B;
+
+        // 原地模式不分配 B
+        if (posix_memalign((void**)&A, 4096, bytes) != 0 ||
+            (!inplace && posix_memalign((void**)&B, 4096, bytes) != 0)) {
+            fprintf(stderr, "posix_memalign error.\n");
+            exit(1);
+        }
+        if (inplace)
+            B = A;
+        fill(A, (size_t)M * N);
+
+        for (int f = 0; f < func_counter; f++) {
+            if (only >= 0 && f != only)
+                continue;
+            if (inplace && !func_list[f].inplace)
+                continue;
+            if (func_list[f].func_ptr != trans_par) {
+                bench(f, M, N, A, B, trials, 1);
+                continue;
+            }
+            for (int r = 0; r < nthreads; r++) {
+                trans_threads = threads[r];
+                bench(f, M, N, A, B, trials, threads[r] ? threads[r] : sysconf(_SC_NPROCESSORS_ONLN));
+            }
+        }
+        free(A);
+        if (!inplace)
+            free(B);
+    }
+
+    struct rusage ru;
+    if (getrusage(RUSAGE_SELF, &ru) == 0)
+        printf("peak RSS %ld KiB\n", ru.ru_maxrss);
+    return 0;
+}
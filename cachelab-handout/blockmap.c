@@ -0,0 +1,52 @@
+/*
+ * blockmap.c - Block address to id map shared by the csim models
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "blockmap.h"
+
+static void grow(blockmap_t* m)
+{
+    unsigned long oldcap = m->cap;
+    unsigned long* oldkey = m->key;
+    uint32_t* oldval = m->val;
+
+    m->cap = oldcap ? 2 * oldcap : 1024;
+    m->key = calloc(m->cap, sizeof(unsigned long));
+    m->val = calloc(m->cap, sizeof(uint32_t));
+    if (m->key == NULL || m->val == NULL) {
+        fprintf(stderr, "calloc error.\n");
+        exit(1);
+    }
+    for (unsigned long i = 0; i < oldcap; i++) {
+        if (oldval[i] != 0) {
+            unsigned long j = blockmap_slot(m, oldkey[i]);
+            m->key[j] = oldkey[i];
+            m->val[j] = oldval[i];
+        }
+    }
+    free(oldkey);
+    free(oldval);
+}
+
+void blockmap_put(blockmap_t* m, unsigned long block, uint32_t val)
+{
+    unsigned long i;
+
+    if (2 * (m->n + 1) >= m->cap)
+        grow(m);
+    i = blockmap_slot(m, block);
+    if (m->val[i] == 0)
+        m->n++;
+    m->key[i] = block;
+    m->val[i] = val;
+}
+
+void blockmap_free(blockmap_t* m)
+{
+    free(m->key);
+    free(m->val);
+    m->key = NULL;
+    m->val = NULL;
+    m->cap = m->n = 0;
+}
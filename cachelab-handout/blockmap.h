@@ -0,0 +1,49 @@
+/*
+ * blockmap.h - Block address to id map shared by the csim models
+ *
+ * Open addressing with linear probing over a power of two table that
+ * doubles at half full. Values are nonzero 32 bit ids, 0 marks an
+ * empty slot, so a zeroed blockmap_t is an empty map. Entries are
+ * never removed; callers that need to forget a block store a value
+ * that says so.
+ */
+#ifndef CACHELAB_BLOCKMAP_H
+#define CACHELAB_BLOCKMAP_H
+
+#include <stdint.h>
+
+typedef struct blockmap {
+    unsigned long* key;
+    uint32_t* val;
+    unsigned long cap;      /* slots, 0 before the first put */
+    unsigned long n;        /* blocks in the map */
+} blockmap_t;
+
+static inline unsigned long blockmap_hash(unsigned long block, unsigned long cap)
+{
+    return (block * 0x9E3779B97F4A7C15UL) >> 20 & (cap - 1);
+}
+
+/* Slot of block, or the empty slot it would go to; cap must not be 0 */
+static inline unsigned long blockmap_slot(const blockmap_t* m, unsigned long block)
+{
+    unsigned long i = blockmap_hash(block, m->cap);
+
+    while (m->val[i] != 0 && m->key[i] != block)
+        i = (i + 1) & (m->cap - 1);
+    return i;
+}
+
+/* Value of block, 0 if it is not in the map */
+static inline uint32_t blockmap_get(const blockmap_t* m, unsigned long block)
+{
+    return m->cap ? m->val[blockmap_slot(m, block)] : 0;
+}
+
+/* Set the value of block to val, which must not be 0. Exits when out of memory. */
+void blockmap_put(blockmap_t* m, unsigned long block, uint32_t val);
+
+/* Release the tables; m itself belongs to the caller */
+void blockmap_free(blockmap_t* m);
+
+#endif /* CACHELAB_BLOCKMAP_H */
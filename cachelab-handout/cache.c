@@ -0,0 +1,909 @@
+/*
+ * cache.c - Set-associative cache model with pluggable replacement
+ *
+ * Each policy provides five inline hooks:
+ *   <p>_hit(c, set, way)       a valid line was referenced
+ *   <p>_victim(c, set)         pick the way to evict from a full set
+ *   <p>_fill(c, set, way)      a new line was placed into way
+ *   <p>_remove(c, set, way)    a line is being invalidated
+ *   <p>_move(c, set, from, to) a line moves to a freed way, so the
+ *                              valid ways stay a prefix of the set
+ * and DEFINE_POLICY() stamps out access loops specialized on them, on
+ * the tag width and on the instruction set used for the tag search,
+ * plus out-of-line wrappers for the general line API.
+ */
+#define _POSIX_C_SOURCE 200112L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cache.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CACHE_X86 1
+#else
+#define CACHE_X86 0
+#endif
+
+#define LINE(c, set, way)   ((set) * (c)->E + (way))
+
+/* Parts of the packed block of a set */
+#define SETP(c, set)        ((c)->sets + (set) * (c)->stride)
+#define SMETA(c, T, set)    ((T*)SETP(c, set))
+#define NVALID(c, set)      ((uint16_t*)(SETP(c, set) + (c)->nvoff))
+#define TAGS(c, T, set)     ((T*)(SETP(c, set) + (c)->tagoff))
+#define LMETA(c, T, set)    ((T*)(SETP(c, set) + (c)->lmetaoff))
+
+/* Vector loads may run this far past the tags of the last set */
+#define SIMD_SLACK          32
+
+int cache_isa = CACHE_ISA_AUTO;
+
+static int widen_access(cache_t* c, unsigned long addr);
+
+/* xorshift32, state must not be 0 */
+static inline uint32_t rand_next(uint32_t* state)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+/*
+ * lru - Lines of a set form a doubly linked list from head (most
+ *     recently used) to tail (least recently used)
+ */
+typedef struct lru_link {
+    uint16_t prev, next;
+} lru_link_t;
+
+typedef struct lru_set {
+    uint16_t head, tail;
+} lru_set_t;
+
+static inline void lru_unlink(lru_set_t* set, lru_link_t* l, int way)
+{
+    if (way == set->head)
+        set->head = l[way].next;
+    else
+        l[l[way].prev].next = l[way].next;
+    if (way == set->tail)
+        set->tail = l[way].prev;
+    else
+        l[l[way].next].prev = l[way].prev;
+}
+
+static inline void lru_fill(cache_t* c, unsigned long set, int way)
+{
+    lru_set_t* ls = SMETA(c, lru_set_t, set);
+    lru_link_t* l = LMETA(c, lru_link_t, set);
+
+    // 链表为空
+    if (*NVALID(c, set) == 1) {
+        ls->head = ls->tail = way;
+        return;
+    }
+    l[way].next = ls->head;
+    l[ls->head].prev = way;
+    ls->head = way;
+}
+
+static inline void lru_hit(cache_t* c, unsigned long set, int way)
+{
+    lru_set_t* ls = SMETA(c, lru_set_t, set);
+
+    if (way != ls->head) {
+        lru_unlink(ls, LMETA(c, lru_link_t, set), way);
+        lru_fill(c, set, way);
+    }
+}
+
+static inline int lru_victim(cache_t* c, unsigned long set)
+{
+    lru_set_t* ls = SMETA(c, lru_set_t, set);
+    int way = ls->tail;
+
+    if (c->E > 1)
+        lru_unlink(ls, LMETA(c, lru_link_t, set), way);
+    return way;
+}
+
+static inline void lru_remove(cache_t* c, unsigned long set, int way)
+{
+    if (*NVALID(c, set) > 1)
+        lru_unlink(SMETA(c, lru_set_t, set), LMETA(c, lru_link_t, set), way);
+}
+
+static inline void lru_move(cache_t* c, unsigned long set, int from, int to)
+{
+    lru_set_t* ls = SMETA(c, lru_set_t, set);
+    lru_link_t* l = LMETA(c, lru_link_t, set);
+
+    l[to] = l[from];
+    if (ls->head == from)
+        ls->head = to;
+    else
+        l[l[from].prev].next = to;
+    if (ls->tail == from)
+        ls->tail = to;
+    else
+        l[l[from].next].prev = to;
+}
+
+/*
+ * fifo - Ways are filled in order, so the oldest line is simply the
+ *     next way of a round robin pointer
+ */
+static inline void fifo_hit(cache_t* c, unsigned long set, int way)
+{
+}
+
+static inline void fifo_fill(cache_t* c, unsigned long set, int way)
+{
+}
+
+static inline int fifo_victim(cache_t* c, unsigned long set)
+{
+    uint16_t* ptr = SMETA(c, uint16_t, set);
+    int way = *ptr;
+
+    *ptr = way + 1 == c->E ? 0 : way + 1;
+    return way;
+}
+
+/* 失效后不再严格按填充顺序, 指针照旧轮转 */
+static inline void fifo_remove(cache_t* c, unsigned long set, int way)
+{
+}
+
+static inline void fifo_move(cache_t* c, unsigned long set, int from, int to)
+{
+}
+
+/*
+ * random - Every set has its own generator so results do not depend
+ *     on the order in which sets are visited
+ */
+static inline void random_hit(cache_t* c, unsigned long set, int way)
+{
+}
+
+static inline void random_fill(cache_t* c, unsigned long set, int way)
+{
+}
+
+static inline int random_victim(cache_t* c, unsigned long set)
+{
+    return rand_next(SMETA(c, uint32_t, set)) % c->E;
+}
+
+static inline void random_remove(cache_t* c, unsigned long set, int way)
+{
+}
+
+static inline void random_move(cache_t* c, unsigned long set, int from, int to)
+{
+}
+
+/*
+ * lfu - Least frequently used, counts are forgotten on eviction
+ */
+static inline void lfu_hit(cache_t* c, unsigned long set, int way)
+{
+    uint32_t* cnt = LMETA(c, uint32_t, set) + way;
+
+    if (*cnt != UINT32_MAX)
+        (*cnt)++;
+}
+
+static inline void lfu_fill(cache_t* c, unsigned long set, int way)
+{
+    LMETA(c, uint32_t, set)[way] = 1;
+}
+
+static inline int lfu_victim(cache_t* c, unsigned long set)
+{
+    uint32_t* cnt = LMETA(c, uint32_t, set);
+    int way = 0;
+
+    for (int i = 1; i < c->E; i++) {
+        if (cnt[i] < cnt[way])
+            way = i;
+    }
+    return way;
+}
+
+static inline void lfu_remove(cache_t* c, unsigned long set, int way)
+{
+}
+
+static inline void lfu_move(cache_t* c, unsigned long set, int from, int to)
+{
+    uint32_t* cnt = LMETA(c, uint32_t, set);
+
+    cnt[to] = cnt[from];
+}
+
+/*
+ * tree-plru - Node k of the tree is bit k-1, a set bit means the victim
+ *     lies in the right half. An access points every node on its path
+ *     away from the accessed way.
+ */
+static inline void tplru_hit(cache_t* c, unsigned long set, int way)
+{
+    uint64_t* t = SMETA(c, uint64_t, set);
+    int node = 1;
+
+    for (int half = c->E >> 1; half; half >>= 1) {
+        if (way & half) {
+            *t &= ~(1UL << (node - 1));
+            node = 2 * node + 1;
+        }
+        else {
+            *t |= 1UL << (node - 1);
+            node = 2 * node;
+        }
+    }
+}
+
+static inline void tplru_fill(cache_t* c, unsigned long set, int way)
+{
+    tplru_hit(c, set, way);
+}
+
+static inline int tplru_victim(cache_t* c, unsigned long set)
+{
+    uint64_t t = *SMETA(c, uint64_t, set);
+    int node = 1, way = 0;
+
+    for (int half = c->E >> 1; half; half >>= 1) {
+        if ((t >> (node - 1)) & 1) {
+            way |= half;
+            node = 2 * node + 1;
+        }
+        else {
+            node = 2 * node;
+        }
+    }
+    return way;
+}
+
+/* 树的状态不属于某一路, 移动后只是近似 */
+static inline void tplru_remove(cache_t* c, unsigned long set, int way)
+{
+}
+
+static inline void tplru_move(cache_t* c, unsigned long set, int from, int to)
+{
+}
+
+/*
+ * bit-plru - Each access sets the way's MRU bit, once all bits would
+ *     be set the others are cleared. The victim is the first clear bit.
+ */
+static inline void bplru_hit(cache_t* c, unsigned long set, int way)
+{
+    uint64_t* mru = SMETA(c, uint64_t, set);
+    uint64_t full = c->E == 64 ? ~0UL : (1UL << c->E) - 1;
+
+    *mru |= 1UL << way;
+    if (*mru == full)
+        *mru = 1UL << way;
+}
+
+static inline void bplru_fill(cache_t* c, unsigned long set, int way)
+{
+    bplru_hit(c, set, way);
+}
+
+static inline int bplru_victim(cache_t* c, unsigned long set)
+{
+    if (c->E == 1)
+        return 0;
+    return __builtin_ctzl(~*SMETA(c, uint64_t, set));
+}
+
+static inline void bplru_remove(cache_t* c, unsigned long set, int way)
+{
+    *SMETA(c, uint64_t, set) &= ~(1UL << way);
+}
+
+static inline void bplru_move(cache_t* c, unsigned long set, int from, int to)
+{
+    uint64_t* mru = SMETA(c, uint64_t, set);
+
+    *mru |= ((*mru >> from) & 1) << to;
+    *mru &= ~(1UL << from);
+}
+
+/*
+ * srrip / brrip - Static and bimodal re-reference interval prediction
+ *     with 2-bit values. Hits predict near-immediate re-reference, the
+ *     victim is the first line predicted distant (3), ageing the whole
+ *     set until one exists.
+ */
+#define RRPV_MAX        3
+#define BRRIP_EPSILON   32      /* 1 in 32 brrip fills are long, not distant */
+
+static inline void srrip_hit(cache_t* c, unsigned long set, int way)
+{
+    LMETA(c, uint8_t, set)[way] = 0;
+}
+
+static inline void srrip_fill(cache_t* c, unsigned long set, int way)
+{
+    LMETA(c, uint8_t, set)[way] = RRPV_MAX - 1;
+}
+
+static inline int srrip_victim(cache_t* c, unsigned long set)
+{
+    uint8_t* rrpv = LMETA(c, uint8_t, set);
+    int way = 0;
+
+    for (int i = 1; i < c->E; i++) {
+        if (rrpv[i] > rrpv[way])
+            way = i;
+    }
+    if (rrpv[way] < RRPV_MAX) {
+        int age = RRPV_MAX - rrpv[way];
+        for (int i = 0; i < c->E; i++)
+            rrpv[i] += age;
+    }
+    return way;
+}
+
+static inline void srrip_remove(cache_t* c, unsigned long set, int way)
+{
+}
+
+static inline void srrip_move(cache_t* c, unsigned long set, int from, int to)
+{
+    uint8_t* rrpv = LMETA(c, uint8_t, set);
+
+    rrpv[to] = rrpv[from];
+}
+
+static inline void brrip_hit(cache_t* c, unsigned long set, int way)
+{
+    srrip_hit(c, set, way);
+}
+
+static inline void brrip_fill(cache_t* c, unsigned long set, int way)
+{
+    uint32_t r = rand_next(SMETA(c, uint32_t, set));
+
+    LMETA(c, uint8_t, set)[way] =
+        r % BRRIP_EPSILON == 0 ? RRPV_MAX - 1 : RRPV_MAX;
+}
+
+static inline int brrip_victim(cache_t* c, unsigned long set)
+{
+    return srrip_victim(c, set);
+}
+
+static inline void brrip_remove(cache_t* c, unsigned long set, int way)
+{
+}
+
+static inline void brrip_move(cache_t* c, unsigned long set, int from, int to)
+{
+    srrip_move(c, set, from, to);
+}
+
+/*
+ * find_<isa><w> - Way among the first n whose tag equals tag, or -1.
+ *     The vector versions compare a whole register of tags at once and
+ *     turn the result into a bit mask, one bit per byte; lanes past n
+ *     may hold anything and are masked off.
+ */
+#define DEFINE_FIND_SCALAR(T, w)                                        \
+static inline int find_scalar##w(const T* tags, int n, T tag)           \
+{                                                                       \
+    for (int way = 0; way < n; way++) {                                 \
+        if (tags[way] == tag)                                           \
+            return way;                                                 \
+    }                                                                   \
+    return -1;                                                          \
+}
+
+DEFINE_FIND_SCALAR(uint16_t, 16)
+DEFINE_FIND_SCALAR(uint32_t, 32)
+DEFINE_FIND_SCALAR(uint64_t, 64)
+
+#if CACHE_X86
+/* SSE2 has no 64-bit compare: both 32-bit halves must be equal */
+static inline __m128i sse2_cmpeq64(__m128i a, __m128i b)
+{
+    __m128i eq = _mm_cmpeq_epi32(a, b);
+    return _mm_and_si128(eq, _mm_shuffle_epi32(eq, _MM_SHUFFLE(2, 3, 0, 1)));
+}
+
+#define DEFINE_FIND_VEC(isa, attr, T, w, V, bytes, load, set1, cmpeq, movemask) \
+static inline attr int find_##isa##w(const T* tags, int n, T tag)      \
+{                                                                       \
+    const int lanes = bytes / sizeof(T);                                \
+    V key = set1(tag);                                                  \
+                                                                        \
+    for (int i = 0; i < n; i += lanes) {                                \
+        unsigned m = movemask(cmpeq(load((const V*)(tags + i)), key));  \
+        if (n - i < lanes)                                              \
+            m &= (1u << ((n - i) * sizeof(T))) - 1;                     \
+        if (m)                                                          \
+            return i + __builtin_ctz(m) / sizeof(T);                    \
+    }                                                                   \
+    return -1;                                                          \
+}
+
+#define AVX2 __attribute__((target("avx2")))
+
+DEFINE_FIND_VEC(sse2, , uint16_t, 16, __m128i, 16, _mm_loadu_si128,
+                _mm_set1_epi16, _mm_cmpeq_epi16, _mm_movemask_epi8)
+DEFINE_FIND_VEC(sse2, , uint32_t, 32, __m128i, 16, _mm_loadu_si128,
+                _mm_set1_epi32, _mm_cmpeq_epi32, _mm_movemask_epi8)
+DEFINE_FIND_VEC(sse2, , uint64_t, 64, __m128i, 16, _mm_loadu_si128,
+                _mm_set1_epi64x, sse2_cmpeq64, _mm_movemask_epi8)
+DEFINE_FIND_VEC(avx2, AVX2, uint16_t, 16, __m256i, 32, _mm256_loadu_si256,
+                _mm256_set1_epi16, _mm256_cmpeq_epi16, _mm256_movemask_epi8)
+DEFINE_FIND_VEC(avx2, AVX2, uint32_t, 32, __m256i, 32, _mm256_loadu_si256,
+                _mm256_set1_epi32, _mm256_cmpeq_epi32, _mm256_movemask_epi8)
+DEFINE_FIND_VEC(avx2, AVX2, uint64_t, 64, __m256i, 32, _mm256_loadu_si256,
+                _mm256_set1_epi64x, _mm256_cmpeq_epi64, _mm256_movemask_epi8)
+#else
+/* 其他平台只有标量版本 */
+#define AVX2
+#define find_sse216 find_scalar16
+#define find_sse232 find_scalar32
+#define find_sse264 find_scalar64
+#define find_avx216 find_scalar16
+#define find_avx232 find_scalar32
+#define find_avx264 find_scalar64
+#endif
+
+/*
+ * DEFINE_ACCESS - The access fast path is one tag search followed by
+ *     the policy hooks, for tags of type T searched with isa
+ */
+#define DEFINE_ACCESS(p, T, w, isa, attr)                               \
+static attr int p##_access_##isa##w(cache_t* c, unsigned long addr)     \
+{                                                                       \
+    unsigned long set = (addr >> c->b) & c->setmask;                    \
+    unsigned long tag = addr >> c->b >> c->s;                           \
+    T* tags = TAGS(c, T, set);                                          \
+    uint16_t* nvalid = NVALID(c, set);                                  \
+    int n = *nvalid;                                                    \
+    int way;                                                            \
+                                                                        \
+    if (tag > c->tagmax)                                                \
+        return widen_access(c, addr);                                   \
+    way = find_##isa##w(tags, n, tag);                                  \
+    if (way >= 0) {                                                     \
+        p##_hit(c, set, way);                                           \
+        return CACHE_HIT;                                               \
+    }                                                                   \
+                                                                        \
+    /* 有空余块 */                                                      \
+    if (n < c->E) {                                                     \
+        way = (*nvalid)++;                                              \
+        tags[way] = tag;                                                \
+        p##_fill(c, set, way);                                          \
+        return CACHE_MISS;                                              \
+    }                                                                   \
+                                                                        \
+    /* 驱逐 */                                                          \
+    way = p##_victim(c, set);                                           \
+    tags[way] = tag;                                                    \
+    p##_fill(c, set, way);                                              \
+    return CACHE_EVICT;                                                 \
+}
+
+/*
+ * DEFINE_POLICY - The access loops for every tag width and search,
+ *     and wrappers the general line API goes through
+ */
+#define DEFINE_POLICY(p)                                                \
+static void p##_hit_fn(cache_t* c, unsigned long set, int way)          \
+{                                                                       \
+    p##_hit(c, set, way);                                               \
+}                                                                       \
+static int p##_victim_fn(cache_t* c, unsigned long set)                 \
+{                                                                       \
+    return p##_victim(c, set);                                          \
+}                                                                       \
+static void p##_fill_fn(cache_t* c, unsigned long set, int way)         \
+{                                                                       \
+    p##_fill(c, set, way);                                              \
+}                                                                       \
+static void p##_remove_fn(cache_t* c, unsigned long set, int way)       \
+{                                                                       \
+    p##_remove(c, set, way);                                            \
+}                                                                       \
+static void p##_move_fn(cache_t* c, unsigned long set, int from, int to)\
+{                                                                       \
+    p##_move(c, set, from, to);                                         \
+}                                                                       \
+DEFINE_ACCESS(p, uint16_t, 16, scalar, )                                \
+DEFINE_ACCESS(p, uint32_t, 32, scalar, )                                \
+DEFINE_ACCESS(p, uint64_t, 64, scalar, )                                \
+DEFINE_ACCESS(p, uint16_t, 16, sse2, )                                  \
+DEFINE_ACCESS(p, uint32_t, 32, sse2, )                                  \
+DEFINE_ACCESS(p, uint64_t, 64, sse2, )                                  \
+DEFINE_ACCESS(p, uint16_t, 16, avx2, AVX2)                              \
+DEFINE_ACCESS(p, uint32_t, 32, avx2, AVX2)                              \
+DEFINE_ACCESS(p, uint64_t, 64, avx2, AVX2)
+
+DEFINE_POLICY(lru)
+DEFINE_POLICY(fifo)
+DEFINE_POLICY(random)
+DEFINE_POLICY(lfu)
+DEFINE_POLICY(tplru)
+DEFINE_POLICY(bplru)
+DEFINE_POLICY(srrip)
+DEFINE_POLICY(brrip)
+
+#define POLICY_OPS(p) \
+    {{p##_access_scalar16, p##_access_scalar32, p##_access_scalar64}, \
+     {p##_access_sse216, p##_access_sse232, p##_access_sse264}, \
+     {p##_access_avx216, p##_access_avx232, p##_access_avx264}}, \
+    p##_hit_fn, p##_victim_fn, p##_fill_fn, p##_remove_fn, p##_move_fn
+
+static const cache_policy_t policies[] = {
+    {"lru",       sizeof(lru_link_t), sizeof(lru_set_t), POLICY_OPS(lru)},
+    {"fifo",      0,                  sizeof(uint16_t),  POLICY_OPS(fifo)},
+    {"random",    0,                  sizeof(uint32_t),  POLICY_OPS(random)},
+    {"lfu",       sizeof(uint32_t),   0,                 POLICY_OPS(lfu)},
+    {"tree-plru", 0,                  sizeof(uint64_t),  POLICY_OPS(tplru)},
+    {"bit-plru",  0,                  sizeof(uint64_t),  POLICY_OPS(bplru)},
+    {"srrip",     sizeof(uint8_t),    0,                 POLICY_OPS(srrip)},
+    {"brrip",     sizeof(uint8_t),    sizeof(uint32_t),  POLICY_OPS(brrip)},
+};
+
+const char cache_policy_names[] =
+    "lru,fifo,random,lfu,tree-plru,bit-plru,srrip,brrip";
+
+/*
+ * find_policy - Look up "name" or "name:seed"
+ */
+static const cache_policy_t* find_policy(const char* spec, uint32_t* seed)
+{
+    const char* colon = strchr(spec, ':');
+    size_t len = colon ? (size_t)(colon - spec) : strlen(spec);
+
+    *seed = colon ? (uint32_t)strtoul(colon + 1, NULL, 0) : 0;
+    for (size_t i = 0; i < sizeof(policies) / sizeof(policies[0]); i++) {
+        if (strlen(policies[i].name) == len &&
+            strncmp(policies[i].name, spec, len) == 0)
+            return &policies[i];
+    }
+    return NULL;
+}
+
+static inline size_t align_up(size_t n, size_t a)
+{
+    return (n + a - 1) / a * a;
+}
+
+/*
+ * layout - Allocate empty set blocks for tags of tagbytes bytes. The
+ *     old blocks, if any, are left to the caller.
+ */
+static int layout(cache_t* c, int tagbytes)
+{
+    const cache_policy_t* p = c->policy;
+    size_t stride;
+    void* sets;
+
+    c->nvoff = p->set_bytes;
+    c->tagoff = align_up(c->nvoff + sizeof(uint16_t), tagbytes);
+    c->lmetaoff = align_up(c->tagoff + (size_t)c->E * tagbytes, 4);
+    stride = align_up(c->lmetaoff + (size_t)c->E * p->line_bytes, 8);
+
+    // 小于一行时补齐到 2 的幂, 一组就不会跨行
+    if (stride < 64) {
+        size_t pow2 = 8;
+        while (pow2 < stride)
+            pow2 *= 2;
+        stride = pow2;
+    }
+
+    if (posix_memalign(&sets, 64, c->nsets * stride + SIMD_SLACK) != 0) {
+        fprintf(stderr, "posix_memalign error.\n");
+        return -1;
+    }
+    memset(sets, 0, c->nsets * stride + SIMD_SLACK);
+    c->sets = sets;
+    c->stride = stride;
+    c->tagbytes = tagbytes;
+    c->tagmax = tagbytes == 8 ? ~0UL : (1UL << (8 * tagbytes)) - 1;
+    c->access = p->access[c->isa - CACHE_ISA_SCALAR][tagbytes == 2 ? 0 : tagbytes == 4 ? 1 : 2];
+    return 0;
+}
+
+static inline unsigned long tag_get(const cache_t* c, unsigned long set, int way)
+{
+    switch (c->tagbytes) {
+    case 2:
+        return TAGS(c, uint16_t, set)[way];
+    case 4:
+        return TAGS(c, uint32_t, set)[way];
+    }
+    return TAGS(c, uint64_t, set)[way];
+}
+
+static inline void tag_set(cache_t* c, unsigned long set, int way, unsigned long tag)
+{
+    switch (c->tagbytes) {
+    case 2:
+        TAGS(c, uint16_t, set)[way] = tag;
+        break;
+    case 4:
+        TAGS(c, uint32_t, set)[way] = tag;
+        break;
+    default:
+        TAGS(c, uint64_t, set)[way] = tag;
+    }
+}
+
+/*
+ * cache_widen - Re-lay the cache out with tags wide enough for addr
+ */
+int cache_widen(cache_t* c, unsigned long addr)
+{
+    cache_t old = *c;
+    unsigned long tag = addr >> c->b >> c->s;
+    int tagbytes = tag <= 0xffff ? 2 : tag <= 0xffffffffUL ? 4 : 8;
+
+    if (tagbytes <= c->tagbytes)
+        return 0;
+    if (layout(c, tagbytes) < 0)
+        return -1;
+
+    // 组元数据和有效数原样复制, tag 逐个放宽
+    for (unsigned long set = 0; set < c->nsets; set++) {
+        memcpy(SETP(c, set), SETP(&old, set), old.nvoff + sizeof(uint16_t));
+        memcpy(LMETA(c, char, set), LMETA(&old, char, set),
+               (size_t)c->E * c->policy->line_bytes);
+        for (int way = 0; way < *NVALID(c, set); way++)
+            tag_set(c, set, way, tag_get(&old, set, way));
+    }
+    free(old.sets);
+    return 0;
+}
+
+/*
+ * widen_access - Slow path of an access whose tag does not fit
+ */
+static int widen_access(cache_t* c, unsigned long addr)
+{
+    if (cache_widen(c, addr) < 0)
+        exit(1);
+    return c->access(c, addr);
+}
+
+/*
+ * pick_isa - Instruction set for the tag search. A vector search only
+ *     pays off once a set spans a few registers' worth of lanes.
+ */
+static int pick_isa(int E)
+{
+    int isa = cache_isa;
+
+    if (isa == CACHE_ISA_AUTO)
+        isa = E < CACHE_SIMD_MINE ? CACHE_ISA_SCALAR : CACHE_ISA_AVX2;
+    if (!CACHE_X86)
+        return CACHE_ISA_SCALAR;
+    if (isa == CACHE_ISA_AVX2 && !cache_isa_supported(CACHE_ISA_AVX2))
+        isa = CACHE_ISA_SSE2;
+    return isa;
+}
+
+int cache_isa_supported(int isa)
+{
+    if (isa == CACHE_ISA_AUTO || isa == CACHE_ISA_SCALAR)
+        return 1;
+#if CACHE_X86
+    __builtin_cpu_init();
+    if (isa == CACHE_ISA_SSE2)
+        return __builtin_cpu_supports("sse2");
+    if (isa == CACHE_ISA_AVX2)
+        return __builtin_cpu_supports("avx2");
+#endif
+    return 0;
+}
+
+/*
+ * cache_new - Allocate an empty cache, returns NULL on bad arguments or
+ *     when out of memory
+ */
+cache_t* cache_new(int s, int E, int b, const char* policy)
+{
+    const cache_policy_t* p;
+    uint32_t seed;
+    cache_t* c;
+
+    if (s < 0 || b < 0 || s + b >= 64 || E < 1 || E > CACHE_MAXE) {
+        fprintf(stderr, "bad cache geometry s=%d E=%d b=%d\n", s, E, b);
+        return NULL;
+    }
+
+    p = find_policy(policy ? policy : "lru", &seed);
+    if (p == NULL) {
+        fprintf(stderr, "unknown replacement policy %s, use one of %s\n",
+                policy, cache_policy_names);
+        return NULL;
+    }
+    if ((p->hit == tplru_hit_fn && (E > 64 || (E & (E - 1)) != 0)) ||
+        (p->hit == bplru_hit_fn && E > 64)) {
+        fprintf(stderr, "%s needs E <= 64%s\n", p->name,
+                p->hit == tplru_hit_fn ? " and a power of 2" : "");
+        return NULL;
+    }
+
+    c = calloc(1, sizeof(cache_t));
+    if (c == NULL)
+        return NULL;
+    c->s = s;
+    c->E = E;
+    c->b = b;
+    c->nsets = 1UL << s;
+    c->setmask = c->nsets - 1;
+    c->policy = p;
+    c->isa = pick_isa(E);
+
+    // 从最窄的 tag 开始, 需要时再放宽
+    if (layout(c, 2) < 0) {
+        free(c);
+        return NULL;
+    }
+
+    // 每组独立的随机数种子
+    if (p->hit == random_hit_fn || p->hit == brrip_hit_fn) {
+        for (unsigned long i = 0; i < c->nsets; i++) {
+            uint32_t* state = SMETA(c, uint32_t, i);
+            *state = (seed + 1) * 2654435761u ^ (uint32_t)(i * 40503u);
+            if (*state == 0)
+                *state = 1;
+        }
+    }
+    return c;
+}
+
+void cache_free(cache_t* c)
+{
+    if (c == NULL)
+        return;
+    free(c->sets);
+    free(c->flags);
+    free(c);
+}
+
+size_t cache_bytes(const cache_t* c)
+{
+    return sizeof(cache_t) + c->nsets * c->stride +
+           (c->flags ? c->nsets * c->E : 0);
+}
+
+/*
+ * cache_enable_flags - Allocate the per-line flag bytes. Only the line
+ *     API below keeps them up to date, cache_access() ignores them.
+ */
+int cache_enable_flags(cache_t* c)
+{
+    if (c->flags == NULL)
+        c->flags = calloc(c->nsets * c->E, sizeof(uint8_t));
+    if (c->flags == NULL) {
+        fprintf(stderr, "calloc error.\n");
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * cache_lookup - Line index of addr, or -1. Does not change any state.
+ */
+long cache_lookup(cache_t* c, unsigned long addr)
+{
+    unsigned long set = (addr >> c->b) & c->setmask;
+    unsigned long tag = addr >> c->b >> c->s;
+    int n = *NVALID(c, set);
+
+    if (tag > c->tagmax)
+        return -1;
+    for (int way = 0; way < n; way++) {
+        if (tag_get(c, set, way) == tag)
+            return LINE(c, set, way);
+    }
+    return -1;
+}
+
+/*
+ * cache_touch - Tell the replacement policy that line was referenced
+ */
+void cache_touch(cache_t* c, long line)
+{
+    c->policy->hit(c, line / c->E, line % c->E);
+}
+
+/*
+ * cache_insert - Place addr, which must not be present, into its set.
+ *     Returns the new line index, its flags are cleared. If a valid
+ *     line had to go, v describes it.
+ */
+long cache_insert(cache_t* c, unsigned long addr, cache_victim_t* v)
+{
+    unsigned long set = (addr >> c->b) & c->setmask;
+    unsigned long tag = addr >> c->b >> c->s;
+    uint16_t* nvalid;
+    int way;
+
+    if (tag > c->tagmax && cache_widen(c, addr) < 0)
+        exit(1);
+    nvalid = NVALID(c, set);
+
+    v->valid = 0;
+    if (*nvalid < c->E) {
+        way = (*nvalid)++;
+    }
+    else {
+        way = c->policy->victim(c, set);
+        v->valid = 1;
+        v->addr = ((tag_get(c, set, way) << c->s | set) << c->b);
+        v->flags = c->flags ? c->flags[LINE(c, set, way)] : 0;
+    }
+    tag_set(c, set, way, tag);
+    if (c->flags)
+        c->flags[LINE(c, set, way)] = 0;
+    c->policy->fill(c, set, way);
+    return LINE(c, set, way);
+}
+
+/*
+ * cache_access_victim - cache_access() that also returns the block it
+ *     evicted in *victim. cache_access() only writes the set it
+ *     touches, so threads on disjoint sets can share a cache.
+ */
+int cache_access_victim(cache_t* c, unsigned long addr, unsigned long* victim)
+{
+    long line = cache_lookup(c, addr);
+    cache_victim_t v;
+
+    if (line >= 0) {
+        cache_touch(c, line);
+        return CACHE_HIT;
+    }
+    cache_insert(c, addr, &v);
+    if (!v.valid)
+        return CACHE_MISS;
+    *victim = v.addr;
+    return CACHE_EVICT;
+}
+
+/*
+ * cache_invalidate - Drop addr from the cache. Returns 1 and its flags
+ *     in *flags if it was present, 0 otherwise.
+ */
+int cache_invalidate(cache_t* c, unsigned long addr, uint8_t* flags)
+{
+    long line = cache_lookup(c, addr);
+    unsigned long set;
+    int way, last;
+
+    if (line < 0)
+        return 0;
+    set = line / c->E;
+    way = line % c->E;
+    last = *NVALID(c, set) - 1;
+    if (flags)
+        *flags = c->flags ? c->flags[line] : 0;
+
+    c->policy->remove(c, set, way);
+    if (way != last) {
+        tag_set(c, set, way, tag_get(c, set, last));
+        if (c->flags)
+            c->flags[line] = c->flags[LINE(c, set, last)];
+        c->policy->move(c, set, last, way);
+    }
+    (*NVALID(c, set))--;
+    return 1;
+}
@@ -0,0 +1,149 @@
+/*
+ * cache.h - Set-associative cache model used by csim
+ *
+ * Valid lines always occupy the first nvalid ways of a set; the tag
+ * search is the only pass over a set. Replacement is pluggable: every
+ * policy owns a per-line and a per-set metadata array sized for just
+ * what it needs, and gets its own specialized access loop, so a cheap
+ * policy never pays for the bookkeeping of an expensive one.
+ *
+ * All state of a set lives in one packed block, so an access touches as
+ * few host cache lines as possible:
+ *
+ *   policy set metadata | nvalid (uint16) | tags[E] | policy line metadata[E]
+ *
+ * Tags are stored 2, 4 or 8 bytes wide. A cache starts with the
+ * narrowest width and is re-laid out to a wider one the first time a
+ * tag does not fit. Blocks narrower than a host cache line are padded
+ * to a power of two so that no set straddles two lines.
+ *
+ * The tag search of a set compares a whole SSE2 or AVX2 register of tags
+ * at once when the host supports it and E >= CACHE_SIMD_MINE; smaller
+ * sets and other hosts use a plain loop.
+ *
+ * cache_access() is all a single-level simulation needs. Models that
+ * move lines around (hierarchies, coherence) use the line API instead,
+ * which also keeps an optional flag byte per line.
+ *
+ *   lru        true LRU, intrusive doubly linked list (2+2 bytes/line)
+ *   fifo       round robin pointer (2 bytes/set)
+ *   random     per-set xorshift state (4 bytes/set), "random:<seed>"
+ *   lfu        access counters (4 bytes/line), ties go to the lowest way
+ *   tree-plru  binary tree of E-1 bits (8 bytes/set), E a power of 2 <= 64
+ *   bit-plru   one MRU bit per way (8 bytes/set), E <= 64
+ *   srrip      2-bit re-reference prediction values (1 byte/line)
+ *   brrip      srrip with bimodal insertion, "brrip:<seed>"
+ */
+#ifndef CACHELAB_CACHE_H
+#define CACHELAB_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define CACHE_MAXE 65535
+#define CACHE_SIMD_MINE 8       /* smallest E searched with vectors */
+
+/* Tag search instruction sets */
+enum {
+    CACHE_ISA_AUTO = 0,         /* best available for the geometry */
+    CACHE_ISA_SCALAR,
+    CACHE_ISA_SSE2,
+    CACHE_ISA_AVX2
+};
+
+/* Search used by caches created from now on, CACHE_ISA_AUTO by default */
+extern int cache_isa;
+int cache_isa_supported(int isa);
+
+/* Outcome of a cache access */
+enum {
+    CACHE_HIT = 0,
+    CACHE_MISS = 1,
+    CACHE_EVICT = 2     /* miss that evicted a valid line */
+};
+
+struct cache_policy;
+
+typedef struct cache {
+    int s, E, b;
+    unsigned long nsets;
+    unsigned long setmask;
+    unsigned char* sets;        /* nsets packed set blocks */
+    size_t stride;              /* bytes per set block */
+    int nvoff;                  /* offsets within a set block */
+    int tagoff;
+    int lmetaoff;
+    int tagbytes;               /* 2, 4 or 8 */
+    int isa;                    /* CACHE_ISA_* of the tag search */
+    unsigned long tagmax;       /* largest tag that fits */
+    uint8_t* flags;             /* per-line CACHE_F_* bits, NULL unless enabled */
+    int (*access)(struct cache* c, unsigned long addr);
+    const struct cache_policy* policy;
+} cache_t;
+
+typedef struct cache_policy {
+    const char* name;
+    int line_bytes;             /* policy metadata per line */
+    int set_bytes;              /* policy metadata per set */
+    /* access loops by search (scalar, sse2, avx2) and tag width (2, 4, 8) */
+    int (*access[3][3])(cache_t* c, unsigned long addr);
+    void (*hit)(cache_t* c, unsigned long set, int way);
+    int (*victim)(cache_t* c, unsigned long set);
+    void (*fill)(cache_t* c, unsigned long set, int way);
+    void (*remove)(cache_t* c, unsigned long set, int way);
+    void (*move)(cache_t* c, unsigned long set, int from, int to);
+} cache_policy_t;
+
+/* Per-line flag bits */
+#define CACHE_F_DIRTY   0x01
+#define CACHE_F_PREFETCH 0x02   /* filled by a prefetch, not referenced since */
+#define CACHE_F_SHARED  0x04   /* other caches may hold a copy */
+
+/* A line pushed out by cache_insert() */
+typedef struct cache_victim {
+    int valid;                  /* a valid line was evicted */
+    unsigned long addr;         /* its block address */
+    uint8_t flags;              /* its flags */
+} cache_victim_t;
+
+/*
+ * Allocate an empty cache with 2^s sets of E lines of 2^b bytes.
+ * policy is "name" or "name:seed", NULL means lru. Returns NULL and
+ * prints a message on bad arguments.
+ */
+cache_t* cache_new(int s, int E, int b, const char* policy);
+void cache_free(cache_t* c);
+
+/* Simulate one access to addr, returns CACHE_HIT, CACHE_MISS or CACHE_EVICT */
+static inline int cache_access(cache_t* c, unsigned long addr)
+{
+    return c->access(c, addr);
+}
+
+/*
+ * Whether the tag of addr fits the current tag width. cache_access()
+ * and cache_insert() widen the cache by themselves; code that shares
+ * one cache between threads checks this and calls cache_widen() while
+ * no other thread is using the cache.
+ */
+static inline int cache_fits(const cache_t* c, unsigned long addr)
+{
+    return (addr >> c->b >> c->s) <= c->tagmax;
+}
+int cache_widen(cache_t* c, unsigned long addr);
+
+/* Host memory used by the model in bytes */
+size_t cache_bytes(const cache_t* c);
+
+/* Line API, lines are identified by set * E + way */
+int cache_enable_flags(cache_t* c);
+long cache_lookup(cache_t* c, unsigned long addr);
+void cache_touch(cache_t* c, long line);
+long cache_insert(cache_t* c, unsigned long addr, cache_victim_t* v);
+int cache_access_victim(cache_t* c, unsigned long addr, unsigned long* victim);
+int cache_invalidate(cache_t* c, unsigned long addr, uint8_t* flags);
+
+/* Comma separated list of policy names, for usage messages */
+extern const char cache_policy_names[];
+
+#endif /* CACHELAB_CACHE_H */
@@ -76,8 +76,20 @@ void registerTransFunction(void (*trans)(int M, int N, int[N][M], int[M][N]),
     func_list[func_counter].func_ptr = trans;
     func_list[func_counter].description = desc;
     func_list[func_counter].correct = 0;
+    func_list[func_counter].inplace = 0;
     func_list[func_counter].num_hits = 0;
     func_list[func_counter].num_misses = 0;
     func_list[func_counter].num_evictions =0;
     func_counter++;
 }
+
+/* 
+ * registerInplaceFunction - Add a function that transposes A in place
+ *     when it is passed as B too
+ */
+void registerInplaceFunction(void (*trans)(int M, int N, int[N][M], int[M][N]), 
+                             char* desc)
+{
+    registerTransFunction(trans, desc);
+    func_list[func_counter - 1].inplace = 1;
+}
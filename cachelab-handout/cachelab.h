@@ -11,6 +11,7 @@ typedef struct trans_func{
   void (*func_ptr)(int M,int N,int[N][M],int[M][N]);
   char* description;
   char correct;
+  char inplace;       /* called with B at the same address as A */
   unsigned int num_hits;
   unsigned int num_misses;
   unsigned int num_evictions;
@@ -34,4 +35,8 @@ void correctTrans(int M, int N, int A[N][M], int B[M][N]);
 void registerTransFunction(
     void (*trans)(int M,int N,int[N][M],int[M][N]), char* desc);
 
+/* Add an in-place function, which gets A as B as well */
+void registerInplaceFunction(
+    void (*trans)(int M,int N,int[N][M],int[M][N]), char* desc);
+
 #endif /* CACHELAB_TOOLS_H */
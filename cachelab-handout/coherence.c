@@ -0,0 +1,360 @@
+/*
+ * coherence.c - Snooping MESI / MOESI coherence between private caches
+ *
+ * Every miss or upgrade is broadcast: the other private caches are
+ * looked up one by one, which is what a snooping bus does and cheap
+ * enough for the handful of cores a trace set has.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "coherence.h"
+
+coh_t* coh_new(const char* spec, int ncores, int s, int E, int b, const char* policy)
+{
+    coh_t* h;
+    char name[8];
+    int llcs = s + 2, llcE = E, quantum = 1;
+
+    if (sscanf(spec, "%7[a-z]:%d:%d:%d", name, &llcs, &llcE, &quantum) < 1 ||
+        (strcmp(name, "mesi") != 0 && strcmp(name, "moesi") != 0)) {
+        fprintf(stderr, "bad coherence spec %s, expected mesi|moesi[:llc_s:llc_E[:quantum]]\n", spec);
+        return NULL;
+    }
+    if (ncores < 1 || ncores > COH_MAXCORES) {
+        fprintf(stderr, "need 1 to %d traces, one -t per core, got %d\n", COH_MAXCORES, ncores);
+        return NULL;
+    }
+    if (quantum < 1) {
+        fprintf(stderr, "bad coherence spec %s, the quantum must be positive\n", spec);
+        return NULL;
+    }
+
+    h = calloc(1, sizeof(coh_t));
+    if (h == NULL) {
+        fprintf(stderr, "calloc error.\n");
+        return NULL;
+    }
+    h->protocol = name[0] == 'm' && name[1] == 'o' ? COH_MOESI : COH_MESI;
+    h->ncores = ncores;
+    h->quantum = quantum;
+    h->chunkbits = b > 6 ? b - 6 : 0;
+
+    for (int i = 0; i < ncores; i++) {
+        h->cores[i].cache = cache_new(s, E, b, policy);
+        if (h->cores[i].cache == NULL || cache_enable_flags(h->cores[i].cache) < 0) {
+            coh_free(h);
+            return NULL;
+        }
+    }
+    h->llc = cache_new(llcs, llcE, b, policy);
+    if (h->llc == NULL || cache_enable_flags(h->llc) < 0) {
+        coh_free(h);
+        return NULL;
+    }
+    return h;
+}
+
+void coh_free(coh_t* h)
+{
+    if (h == NULL)
+        return;
+    for (int i = 0; i < h->ncores; i++)
+        cache_free(h->cores[i].cache);
+    cache_free(h->llc);
+    blockmap_free(&h->map);
+    free(h->blocks);
+    free(h);
+}
+
+/*
+ * find - Sharing history of block, NULL if there is none and create is
+ *     not set
+ */
+static coh_block_t* find(coh_t* h, unsigned long block, int create)
+{
+    uint32_t i = blockmap_get(&h->map, block);
+    coh_block_t* bigger;
+
+    if (i != 0)
+        return &h->blocks[i - 1];
+    if (!create)
+        return NULL;
+    if (h->nblocks == h->cap) {
+        h->cap = h->cap ? 2 * h->cap : 1024;
+        bigger = realloc(h->blocks, h->cap * sizeof(coh_block_t));
+        if (bigger == NULL) {
+            fprintf(stderr, "realloc error.\n");
+            exit(1);
+        }
+        h->blocks = bigger;
+    }
+    memset(&h->blocks[h->nblocks], 0, sizeof(coh_block_t));
+    h->blocks[h->nblocks].block = block;
+    blockmap_put(&h->map, block, ++h->nblocks);
+    return &h->blocks[h->nblocks - 1];
+}
+
+/*
+ * chunks - The written[] bits covered by an access
+ */
+static uint64_t chunks(coh_t* h, unsigned long addr, unsigned int size)
+{
+    unsigned long blockmask = (1UL << h->llc->b) - 1;
+    unsigned long off = addr & blockmask;
+    unsigned long last = off + (size ? size : 1) - 1;
+    int lo, hi;
+
+    if (last > blockmask)
+        last = blockmask;
+    lo = off >> h->chunkbits;
+    hi = last >> h->chunkbits;
+    return (hi == 63 ? ~0UL : (1UL << (hi + 1)) - 1) & ~((1UL << lo) - 1);
+}
+
+static void llc_read(coh_t* h, unsigned long addr)
+{
+    long line = cache_lookup(h->llc, addr);
+    cache_victim_t v;
+
+    if (line >= 0) {
+        h->llchits++;
+        cache_touch(h->llc, line);
+        return;
+    }
+    h->llcmisses++;
+    h->memreads++;
+    cache_insert(h->llc, addr, &v);
+    if (v.valid && (v.flags & CACHE_F_DIRTY))
+        h->memwrites++;
+}
+
+static void llc_write(coh_t* h, unsigned long addr)
+{
+    long line = cache_lookup(h->llc, addr);
+    cache_victim_t v;
+
+    // 写回整块, LLC 缺失也不用先读内存
+    if (line < 0) {
+        line = cache_insert(h->llc, addr, &v);
+        if (v.valid && (v.flags & CACHE_F_DIRTY))
+            h->memwrites++;
+    }
+    else {
+        cache_touch(h->llc, line);
+    }
+    h->llc->flags[line] |= CACHE_F_DIRTY;
+}
+
+/*
+ * fill - Install a block into a private cache, returns CACHE_MISS or
+ *     CACHE_EVICT
+ */
+static int fill(coh_t* h, int core, unsigned long addr, uint8_t flags)
+{
+    coh_core_t* p = &h->cores[core];
+    cache_victim_t v;
+    long line = cache_insert(p->cache, addr, &v);
+
+    p->cache->flags[line] = flags;
+    if (!v.valid)
+        return CACHE_MISS;
+    p->evictions++;
+    if (v.flags & CACHE_F_DIRTY) {
+        p->writebacks++;
+        llc_write(h, v.addr);
+    }
+    return CACHE_EVICT;
+}
+
+/*
+ * snoop_read - Another core reads addr. Returns whether anyone else
+ *     holds it, *supplied whether one of them had it dirty.
+ */
+static int snoop_read(coh_t* h, int core, unsigned long addr, int* supplied)
+{
+    int shared = 0;
+
+    *supplied = 0;
+    for (int i = 0; i < h->ncores; i++) {
+        coh_core_t* p = &h->cores[i];
+        long line;
+        if (i == core || (line = cache_lookup(p->cache, addr)) < 0)
+            continue;
+        shared = 1;
+        // M/O 提供数据; MESI 的 M 同时写回 LLC 变为 S, MOESI 的变为 O
+        if ((p->cache->flags[line] & CACHE_F_DIRTY) && h->protocol == COH_MESI) {
+            *supplied = 1;
+            p->writebacks++;
+            llc_write(h, addr);
+            p->cache->flags[line] = CACHE_F_SHARED;
+        }
+        else {
+            *supplied |= p->cache->flags[line] & CACHE_F_DIRTY;
+            p->cache->flags[line] |= CACHE_F_SHARED;
+        }
+    }
+    return shared;
+}
+
+/*
+ * invalidate - Drop every other copy of addr before core writes it.
+ *     Returns whether one of them was dirty.
+ */
+static int invalidate(coh_t* h, int core, unsigned long addr)
+{
+    int dirty = 0;
+
+    for (int i = 0; i < h->ncores; i++) {
+        uint8_t flags;
+        if (i != core && cache_invalidate(h->cores[i].cache, addr, &flags)) {
+            coh_block_t* bl = find(h, addr >> h->llc->b, 1);
+            h->cores[i].invalidated++;
+            bl->invalidations++;
+            bl->lost |= 1u << i;
+            bl->written[i] = 0;
+            dirty |= flags & CACHE_F_DIRTY;
+        }
+    }
+    return dirty;
+}
+
+/*
+ * miss - Account a miss of core, telling coherence misses apart
+ */
+static void miss(coh_t* h, int core, unsigned long addr, uint64_t touched)
+{
+    coh_core_t* p = &h->cores[core];
+    coh_block_t* bl = h->nblocks ? find(h, addr >> h->llc->b, 0) : NULL;
+
+    p->misses++;
+    if (bl == NULL || !(bl->lost & (1u << core)))
+        return;
+    bl->lost &= ~(1u << core);
+    bl->cohmisses++;
+    p->cohmisses++;
+    if (!(bl->written[core] & touched)) {
+        bl->falsemisses++;
+        p->falsemisses++;
+    }
+}
+
+static int coh_read(coh_t* h, int core, unsigned long addr, uint64_t touched)
+{
+    coh_core_t* p = &h->cores[core];
+    long line = cache_lookup(p->cache, addr);
+    int shared, supplied;
+
+    if (line >= 0) {
+        p->hits++;
+        cache_touch(p->cache, line);
+        return CACHE_HIT;
+    }
+
+    miss(h, core, addr, touched);
+    h->busreads++;
+    shared = snoop_read(h, core, addr, &supplied);
+    if (supplied)
+        h->transfers++;
+    else
+        llc_read(h, addr);
+    return fill(h, core, addr, shared ? CACHE_F_SHARED : 0);
+}
+
+static int coh_write(coh_t* h, int core, unsigned long addr, uint64_t touched)
+{
+    coh_core_t* p = &h->cores[core];
+    long line = cache_lookup(p->cache, addr);
+    coh_block_t* bl;
+    int outcome;
+
+    if (line >= 0) {
+        p->hits++;
+        cache_touch(p->cache, line);
+        // S 和 O 需要先让其他副本失效
+        if (p->cache->flags[line] & CACHE_F_SHARED) {
+            h->upgrades++;
+            invalidate(h, core, addr);
+        }
+        p->cache->flags[line] = CACHE_F_DIRTY;
+        outcome = CACHE_HIT;
+    }
+    else {
+        miss(h, core, addr, touched);
+        h->busreadx++;
+        if (invalidate(h, core, addr))
+            h->transfers++;
+        else
+            llc_read(h, addr);
+        outcome = fill(h, core, addr, CACHE_F_DIRTY);
+    }
+
+    // 失去副本的核记下此后别人写过的部分
+    if (h->nblocks && (bl = find(h, addr >> h->llc->b, 0)) != NULL) {
+        for (int i = 0; i < h->ncores; i++) {
+            if (bl->lost & (1u << i))
+                bl->written[i] |= touched;
+        }
+    }
+    return outcome;
+}
+
+int coh_access(coh_t* h, int core, char op, unsigned long addr, unsigned int size)
+{
+    uint64_t touched = chunks(h, addr, size);
+    int outcome;
+
+    switch (op) {
+    case 'L':
+        return coh_read(h, core, addr, touched);
+    case 'S':
+        return coh_write(h, core, addr, touched);
+    case 'M':
+        outcome = coh_read(h, core, addr, touched);
+        coh_write(h, core, addr, touched);
+        return outcome;
+    }
+    return CACHE_HIT;
+}
+
+static int by_sharing(const void* a, const void* b)
+{
+    const coh_block_t* x = a;
+    const coh_block_t* y = b;
+
+    if (x->falsemisses != y->falsemisses)
+        return x->falsemisses > y->falsemisses ? -1 : 1;
+    if (x->invalidations != y->invalidations)
+        return x->invalidations > y->invalidations ? -1 : 1;
+    return x->block < y->block ? -1 : x->block > y->block;
+}
+
+void coh_print(coh_t* h)
+{
+    coh_block_t* hot;
+
+    printf("%-6s %10s %10s %10s %10s %10s %10s %10s\n", "core", "hits", "misses",
+           "evictions", "cohmisses", "false", "invals", "writebacks");
+    for (int i = 0; i < h->ncores; i++) {
+        coh_core_t* p = &h->cores[i];
+        printf("%-6d %10ld %10ld %10ld %10ld %10ld %10ld %10ld\n", i, p->hits,
+               p->misses, p->evictions, p->cohmisses, p->falsemisses,
+               p->invalidated, p->writebacks);
+    }
+    printf("llc hits:%ld misses:%ld memory reads:%ld writes:%ld\n",
+           h->llchits, h->llcmisses, h->memreads, h->memwrites);
+    printf("bus reads:%ld readx:%ld upgrades:%ld transfers:%ld\n",
+           h->busreads, h->busreadx, h->upgrades, h->transfers);
+
+    // 假共享最多的块
+    hot = malloc((h->nblocks + 1) * sizeof(coh_block_t));
+    if (hot == NULL)
+        return;
+    memcpy(hot, h->blocks, h->nblocks * sizeof(coh_block_t));
+    qsort(hot, h->nblocks, sizeof(coh_block_t), by_sharing);
+    printf("%-18s %12s %10s %10s\n", "block", "invalidations", "cohmisses", "false");
+    for (unsigned long i = 0; i < h->nblocks && i < 10; i++)
+        printf("%-18lx %12ld %10ld %10ld\n", hot[i].block << h->llc->b,
+               hot[i].invalidations, hot[i].cohmisses, hot[i].falsemisses);
+    free(hot);
+}
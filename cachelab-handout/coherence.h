@@ -0,0 +1,92 @@
+/*
+ * coherence.h - Snooping MESI / MOESI coherence between private caches
+ *
+ * Each core has a private cache with the -s -E -b geometry in front of
+ * a shared last-level cache with the same block size. The protocol is
+ * given as "mesi|moesi[:llc_s:llc_E[:quantum]]": the LLC defaults to
+ * the private geometry with four times the sets, and quantum is how
+ * many data records a core replays before the next core takes its
+ * turn (1 by default).
+ *
+ * States live in the line flags: M is dirty, E is neither dirty nor
+ * shared, S is shared, O (MOESI only) is dirty and shared. A dirty line
+ * read by another core is written back to the LLC under MESI and stays
+ * with its owner as O under MOESI. Blocks are handed from cache to
+ * cache when another core has them dirty, otherwise they come from the
+ * LLC. The LLC is non-inclusive and write-back.
+ *
+ * A miss on a block that the core lost to an invalidation is a
+ * coherence miss. It is a false sharing miss when none of the bytes it
+ * touches were written by another core since the invalidation.
+ */
+#ifndef CACHELAB_COHERENCE_H
+#define CACHELAB_COHERENCE_H
+
+#include <stdint.h>
+#include "cache.h"
+#include "blockmap.h"
+
+#define COH_MAXCORES    16
+
+enum {
+    COH_MESI = 0,
+    COH_MOESI
+};
+
+typedef struct coh_core {
+    cache_t* cache;
+    long hits;
+    long misses;
+    long evictions;
+    long cohmisses;         /* misses after losing the block to a write */
+    long falsemisses;       /* of those, to bytes nobody else wrote */
+    long invalidated;       /* copies dropped for other cores */
+    long writebacks;        /* dirty blocks sent to the LLC */
+} coh_core_t;
+
+/* Sharing history of one block, kept once it is first invalidated */
+typedef struct coh_block {
+    unsigned long block;
+    uint32_t lost;          /* cores whose copy was invalidated */
+    long invalidations;
+    long cohmisses;
+    long falsemisses;
+    uint64_t written[COH_MAXCORES]; /* chunks written by others since lost */
+} coh_block_t;
+
+typedef struct coh {
+    int protocol;
+    int ncores;
+    int quantum;
+    int chunkbits;          /* a written[] bit stands for 2^chunkbits bytes */
+    coh_core_t cores[COH_MAXCORES];
+    cache_t* llc;
+
+    blockmap_t map;         /* block -> index into blocks, plus one */
+    coh_block_t* blocks;
+    unsigned long cap;
+    unsigned long nblocks;
+
+    long busreads;          /* read misses */
+    long busreadx;          /* write misses */
+    long upgrades;          /* writes to S or O lines */
+    long transfers;         /* blocks supplied by another private cache */
+    long llchits;
+    long llcmisses;
+    long memreads;
+    long memwrites;
+} coh_t;
+
+/* NULL and a message on a bad spec */
+coh_t* coh_new(const char* spec, int ncores, int s, int E, int b, const char* policy);
+void coh_free(coh_t* h);
+
+/*
+ * One data record of a core; M is a read and then a write. Returns
+ * CACHE_HIT, CACHE_MISS or CACHE_EVICT for the first access.
+ */
+int coh_access(coh_t* h, int core, char op, unsigned long addr, unsigned int size);
+
+void coh_print(coh_t* h);
+
+#endif /* CACHELAB_COHERENCE_H */
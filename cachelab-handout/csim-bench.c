@@ -0,0 +1,165 @@
+/*
+ * csim-bench.c - Measure the throughput of the cache model in cache.c
+ *
+ * A synthetic stream of random block addresses is generated up front,
+ * then replayed through a fresh cache for every associativity in the
+ * list. The number of sets stays fixed, and the stream covers twice
+ * the capacity of each cache, so hits, fills and evictions all occur.
+ * -i repeats each run with several tag searches (scalar, sse2, avx2),
+ * which is the lookup microbenchmark for the vectorized search.
+ * -a moves the stream up to a base address, e.g. 0x7ff000000000 for
+ * stack-like addresses whose tags need the widest layout.
+ * With -o the stream for the last E is also written out as a lackey
+ * trace, so csim can be timed on the same input.
+ */
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+#include "cache.h"
+
+static unsigned long rng = 88172645463325252UL;
+
+/* xorshift64 */
+static unsigned long next_rand(void)
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return rng;
+}
+
+static const char* isa_names[] = {"auto", "scalar", "sse2", "avx2"};
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void usage(char* argv[])
+{
+    printf("Usage: %s [-h] [-s <s>] [-b <b>] [-E <list>] [-n <count>] [-p <policy>]\n"
+           "       [-i <list>] [-a <base>] [-o <file>]\n", argv[0]);
+    printf("Options:\n");
+    printf("  -h          Print this help message.\n");
+    printf("  -s <s>      Number of set index bits (default 6).\n");
+    printf("  -b <b>      Number of block bits (default 6).\n");
+    printf("  -E <list>   Comma separated associativities (default 1,2,4,8,16,32,64).\n");
+    printf("  -n <count>  Accesses per run (default 10000000).\n");
+    printf("  -p <policy> Replacement policy (default lru): %s.\n", cache_policy_names);
+    printf("  -i <list>   Comma separated tag searches: auto,scalar,sse2,avx2 (default auto).\n");
+    printf("  -a <base>   Add base to every address (default 0).\n");
+    printf("  -o <file>   Also write the last stream as a lackey trace.\n");
+    printf("Example: %s -s 0 -E 64,256,1024\n", argv[0]);
+}
+
+int main(int argc, char* argv[])
+{
+    int s = 6, b = 6;
+    char elist[256] = "1,2,4,8,16,32,64";
+    char* outname = NULL;
+    char* policy = "lru";
+    long n = 10000000;
+    unsigned long base = 0;
+    unsigned long* addrs;
+    int isas[4] = {CACHE_ISA_AUTO}, nisa = 1;
+    int c;
+
+    while ((c = getopt(argc, argv, "s:b:E:n:o:p:a:i:h")) != -1) {
+        switch (c) {
+        case 's':
+            s = atoi(optarg);
+            break;
+        case 'b':
+            b = atoi(optarg);
+            break;
+        case 'E':
+            strncpy(elist, optarg, sizeof(elist) - 1);
+            break;
+        case 'n':
+            n = atol(optarg);
+            break;
+        case 'o':
+            outname = optarg;
+            break;
+        case 'p':
+            policy = optarg;
+            break;
+        case 'a':
+            base = strtoul(optarg, NULL, 0);
+            break;
+        case 'i':
+            nisa = 0;
+            for (char* i = strtok(optarg, ","); i != NULL && nisa < 4; i = strtok(NULL, ",")) {
+                int k = 0;
+                while (k < 4 && strcmp(isa_names[k], i) != 0)
+                    k++;
+                if (k == 4 || !cache_isa_supported(k)) {
+                    fprintf(stderr, "tag search %s is unknown or not supported here\n", i);
+                    exit(1);
+                }
+                isas[nisa++] = k;
+            }
+            break;
+        case 'h':
+            usage(argv);
+            exit(0);
+        default:
+            usage(argv);
+            exit(1);
+        }
+    }
+
+    addrs = malloc(n * sizeof(unsigned long));
+    if (addrs == NULL) {
+        fprintf(stderr, "malloc error.\n");
+        exit(1);
+    }
+
+    printf("%6s %7s %10s %10s %12s %10s\n", "E", "search", "hit rate", "seconds",
+           "Macc/s", "MiB");
+    for (char* e = strtok(elist, ","); e != NULL; e = strtok(NULL, ",")) {
+        int E = atoi(e);
+        unsigned long blocks = (2UL << s) * E;
+
+        for (long i = 0; i < n; i++)
+            addrs[i] = base + ((next_rand() % blocks) << b);
+
+        for (int k = 0; k < nisa; k++) {
+            long hits = 0;
+            cache_t* cache;
+            double t;
+
+            cache_isa = isas[k];
+            cache = cache_new(s, E, b, policy);
+            if (cache == NULL)
+                exit(1);
+
+            t = now();
+            for (long i = 0; i < n; i++)
+                hits += cache_access(cache, addrs[i]) == CACHE_HIT;
+            t = now() - t;
+
+            printf("%6d %7s %10.3f %10.3f %12.2f %10.1f\n", E, isa_names[cache->isa],
+                   (double)hits / n, t, n / t / 1e6, cache_bytes(cache) / 1048576.0);
+            cache_free(cache);
+        }
+    }
+
+    if (outname != NULL) {
+        FILE* fp = fopen(outname, "w");
+        if (fp == NULL) {
+            perror(outname);
+            exit(1);
+        }
+        for (long i = 0; i < n; i++)
+            fprintf(fp, " L %lx,4\n", addrs[i]);
+        fclose(fp);
+    }
+    free(addrs);
+    return 0;
+}
@@ -9,10 +9,28 @@
 #define print(x) if (infoflag) printf(x)
 
 #include "cachelab.h"
+#include "trace.h"
+#include "cache.h"
+#include "hier.h"
+#include "sweep.h"
+#include "reuse.h"
+#include "shard.h"
+#include "region.h"
+#include "shadow.h"
+#include "prefetch.h"
+#include "tlb.h"
+#include "coherence.h"
 #include "assert.h"
 
-void getaddrfromline(char* buff, char* result);
-long getlownnumber(long addr, long n);
+// 缺失类别, 按 SHADOW_* 编号
+static const char* misskind[] = {"conflict", "capacity", "compulsory"};
+
+void printrec(trace_rec_t* rec);
+int runhier(char* hierspec, trace_t* fp, bool infoflag);
+int runreuse(char* range, long blockbits, char* outprefix, trace_t* fp);
+int runregions(char* regionspec, cache_t* cache, trace_t* fp, bool infoflag);
+int runcoherence(char* cohspec, char** traces, int ntraces, int s, int E, int b,
+                 char* policy, bool infoflag);
 
 int main(int argc, char* argv[])
 {
@@ -22,22 +40,54 @@ int main(int argc, char* argv[])
     long miss_count = 0;
 
     // 缓存相关数据
-    long tagbits = 0;
     long setsbits = 0;
     long linesperset = 0;
     long blockbits = 0;
 
-    // 文件名
+    // 文件名, 一致性模式下每个核一个
     char* filename = NULL;
+    char* traces[COH_MAXCORES];
+    int ntraces = 0;
+
+    // 替换策略, 默认 LRU
+    char* policy = "lru";
+
+    // 多级缓存描述 (文件或内联)
+    char* hierspec = NULL;
+
+    // 一次遍历模拟多组参数
+    sweep_t* sweep = NULL;
+
+    // 线程数
+    int nthreads = 1;
+
+    // 栈距离分析的组数范围和输出文件前缀
+    char* reuserange = NULL;
+    char* outprefix = NULL;
+
+    // 地址区域描述 (文件或内联)
+    char* regionspec = NULL;
+
+    // 是否把缺失分为 compulsory/capacity/conflict
+    bool classify = false;
+    shadow_t* shadow = NULL;
+
+    // 硬件预取器描述
+    char* prefetchspec = NULL;
+    prefetch_t* prefetcher = NULL;
+
+    // 数据 TLB 描述 (文件或内联)
+    char* tlbspec = NULL;
+    tlb_t* tlb = NULL;
+
+    // 多核一致性协议描述
+    char* cohspec = NULL;
 
     // 是否输出具体信息
     bool infoflag = false;
 
     // 文件
-    FILE* fp = NULL;
-
-    // 实现 LRU 变量
-    long max = 1;
+    trace_t* fp = NULL;
 
     // 解析命令行参数
     for (long i=1; i<argc; i++){
@@ -63,172 +113,421 @@ int main(int argc, char* argv[])
         
         case 't':
             filename = argv[++i];
+            // 全部计数, 多于 COH_MAXCORES 个由 coh_new 报错
+            if (ntraces < COH_MAXCORES)
+                traces[ntraces] = filename;
+            ntraces++;
+            break;
+
+        case 'p':
+            policy = argv[++i];
+            break;
+
+        case 'H':
+            hierspec = argv[++i];
+            break;
+
+        case 'S':
+            if (sweep == NULL && (sweep = sweep_new()) == NULL) {
+                return -1;
+            }
+            if (sweep_add(sweep, argv[++i], policy) < 0) {
+                return -1;
+            }
+            break;
+
+        case 'j':
+            nthreads = atoi(argv[++i]);
+            break;
+
+        case 'R':
+            reuserange = argv[++i];
+            break;
+
+        case 'o':
+            outprefix = argv[++i];
+            break;
+
+        case 'A':
+            regionspec = argv[++i];
+            break;
+
+        case 'C':
+            classify = true;
+            break;
+
+        case 'P':
+            prefetchspec = argv[++i];
+            break;
+
+        case 'T':
+            tlbspec = argv[++i];
+            break;
+
+        case 'M':
+            cohspec = argv[++i];
             break;
 
         default:
-            fprintf(stderr, "Parameter error, you should use -v -s number -E number -b number -t filename");
+            fprintf(stderr, "Parameter error, you should use -v -s number -E number -b number -t filename [-p policy] [-j threads] [-C] [-P prefetcher] [-T tlb]\n");
+            fprintf(stderr, "or -v -H hierarchy -t filename, hierarchy is a file or \"name i|d|u s E b [policy] [inclusion];...\"\n");
+            fprintf(stderr, "or [-p policy] -S s:E:b [-S s:E:b ...] [-j threads] -t filename, e.g. -S 1-8:1,2,4:5\n");
+            fprintf(stderr, "or -R smin-smax -b number [-o prefix] -t filename for LRU miss ratio curves\n");
+            fprintf(stderr, "or -M mesi|moesi[:llc_s:llc_E[:quantum]] with -s -E -b [-p policy] and one -t per core\n");
+            fprintf(stderr, "or -A regions with -s -E -b -t to attribute misses, regions is a file or \"name start end [data|code];...\"\n");
+            fprintf(stderr, "prefetcher: next|stride|stream[:degree[:distance[:entries]]]\n");
+            fprintf(stderr, "tlb: a file or \"name entries ways [4k|2m] [policy];...\"\n");
+            fprintf(stderr, "policy: %s, random and brrip take an optional :seed\n", cache_policy_names);
             return -1;
         }
 
     }
 
-    // 地址剩余位数应该为 tag 的位数
-    tagbits = sizeof(void*) * 8 - setsbits - blockbits;
+    // 多核模式自己打开每个 trace
+    if (cohspec != NULL) {
+        return runcoherence(cohspec, traces, ntraces, setsbits, linesperset, blockbits,
+                            policy, infoflag);
+    }
+
+    if (filename == NULL || (fp = trace_open(filename)) == NULL) {
+        fprintf(stderr, "can not open trace file.\n");
+        return -1;
+    }
+
+    // 多级缓存模式
+    if (hierspec != NULL) {
+        int rc = runhier(hierspec, fp, infoflag);
+        trace_close(fp);
+        return rc;
+    }
+
+    // 栈距离模式
+    if (reuserange != NULL) {
+        int rc = runreuse(reuserange, blockbits, outprefix, fp);
+        trace_close(fp);
+        return rc;
+    }
 
-    assert(tagbits > 0);
+    // 扫描模式, 每条记录只解码一次
+    if (sweep != NULL) {
+        int rc = sweep_run(sweep, fp, nthreads);
+        if (rc == 0) {
+            sweep_print(sweep);
+        }
+        sweep_free(sweep);
+        trace_close(fp);
+        return rc;
+    }
 
-    // cache块数
-    long count = (1 << setsbits) * linesperset;
+    // 地址剩余位数应该为 tag 的位数
+    assert(sizeof(void*) * 8 - setsbits - blockbits > 0);
+
+    // 替换策略由 cache 模块按组维护
+    cache_t* cache = cache_new(setsbits, linesperset, blockbits, policy);
+    if (cache == NULL) {
+        return -1;
+    }
 
-    // tag 和 used 用来模拟 cache
-    // calloc: malloc and memset 0
-    long* tagptr = calloc(count, sizeof(long));
-    long* usedptr = calloc(count, sizeof(long));
+    // 按区域统计
+    if (regionspec != NULL) {
+        int rc = runregions(regionspec, cache, fp, infoflag);
+        cache_free(cache);
+        trace_close(fp);
+        return rc;
+    }
 
-    if (usedptr == NULL || tagptr == NULL){
-        fprintf(stderr, "calloc error.");
+    // 全相联 LRU 影子缓存, 容量与 cache 相同
+    if (classify && (shadow = shadow_new(blockbits, cache->nsets * linesperset)) == NULL) {
         return -1;
     }
 
-    fp = fopen(filename, "r");
+    // 预取器直接填充 cache
+    if (prefetchspec != NULL && (prefetcher = prefetch_new(prefetchspec, cache)) == NULL) {
+        return -1;
+    }
 
-    char buff[1024];
-    char number[1024];
-    long addr;
+    // TLB 与 cache 看同一串地址
+    if (tlbspec != NULL && (tlb = tlb_load(tlbspec)) == NULL) {
+        return -1;
+    }
 
-    long set;
-    long tag;
+    // 多线程时按组分给各线程, 它读完整个 trace, 下面的循环不再执行;
+    // -v 需要按顺序输出, -C 的影子缓存, 预取器和 TLB 是全局的, 都只能串行
+    if (nthreads > 1 && !infoflag && shadow == NULL && prefetcher == NULL && tlb == NULL) {
+        if (shard_run(cache, fp, nthreads, &hit_count, &miss_count, &eviction_count) < 0) {
+            return -1;
+        }
+    }
 
-    while (fgets(buff, 1024, fp) != NULL) {
-        memset(number, 0, 1024);
+    trace_rec_t rec;
 
+    while (trace_next(fp, &rec)) {
         // 忽略 I 开头的行
-        if(*(buff) == 'I')continue;
+        if (rec.op == 'I') continue;
+
+        if (infoflag) {
+            printrec(&rec);
+        }
+
+        // 影子缓存的结果决定缺失的类别
+        int kind = shadow != NULL ? shadow_access(shadow, rec.addr) : SHADOW_HIT;
+        int outcome = prefetcher != NULL ? prefetch_access(prefetcher, rec.addr)
+                                         : cache_access(cache, rec.addr);
+
+        switch (outcome) {
+        case CACHE_HIT:
+            print("hit ");
+            hit_count++;
+            break;
+
+        case CACHE_MISS:
+            print("miss ");
+            miss_count++;
+            break;
+
+        default:
+            print("miss eviction ");
+            miss_count++;
+            eviction_count++;
+            break;
+        }
+        if (shadow != NULL && outcome != CACHE_HIT) {
+            shadow_classify(shadow, kind);
+            if (infoflag) {
+                printf("%s ", misskind[kind]);
+            }
+        }
+
+        // 一条指令只翻译一次地址
+        if (tlb != NULL && tlb_access(tlb, rec.addr) == tlb->nlevels) {
+            print("walk ");
+        }
+
+        // M = L + S, 第二次访问一定命中, 预取器只训练一次
+        if (rec.op == 'M') {
+            cache_access(cache, rec.addr);
+            if (shadow != NULL) {
+                shadow_access(shadow, rec.addr);
+            }
+            print("hit ");
+            hit_count++;
+        }
+        print("\n");
+    }
+
+    printf("hits:%ld ", hit_count);
+    printf("misses:%ld ", miss_count);
+    printf("evictions:%ld\n", eviction_count);
+    printSummary(hit_count, miss_count, eviction_count);
+    if (shadow != NULL) {
+        printf("compulsory:%ld capacity:%ld conflict:%ld\n",
+               shadow->compulsory, shadow->capacity, shadow->conflict);
+        shadow_free(shadow);
+    }
+    if (prefetcher != NULL) {
+        prefetch_print(prefetcher, miss_count);
+        prefetch_free(prefetcher);
+    }
+    if (tlb != NULL) {
+        tlb_print(tlb);
+        tlb_free(tlb);
+    }
+    cache_free(cache);
+    trace_close(fp);
+    return 0;
+}
+
+void printrec(trace_rec_t* rec) {
+    // 行头空格已被 trace_next 去掉, 二进制 trace 没有原文
+    if (rec->line != NULL) {
+        printf("%.*s ", rec->len, rec->line);
+    }
+    else {
+        printf("%c %lx,%u ", rec->op, rec->addr, rec->size);
+    }
+}
 
-        // 去掉行尾回车
-        if(buff[strlen(buff)-1] == '\n')buff[strlen(buff)-1] = '\0';
+int runhier(char* hierspec, trace_t* fp, bool infoflag) {
+    hier_t* h = hier_load(hierspec);
+    trace_rec_t rec;
 
-        // 去掉行头空格
-        if(infoflag && buff[0] == ' ') {
-            printf("%s ", buff + 1);
+    if (h == NULL) {
+        return -1;
+    }
+
+    // I 开头的行交给 l1i, 没有 l1i 时忽略
+    while (trace_next(fp, &rec)) {
+        int tier = hier_access(h, rec.op, rec.addr);
+        if (infoflag && tier >= 0) {
+            printrec(&rec);
+            printf("%s\n", hier_tier_name(h, rec.op, tier));
         }
-        else if (infoflag) {
-            printf("%s ", buff);
+    }
+
+    hier_print(h);
+    hier_free(h);
+    return 0;
+}
+
+int runreuse(char* range, long blockbits, char* outprefix, trace_t* fp) {
+    int smin = 0, smax = 0;
+    trace_rec_t rec;
+
+    // "3" 或 "0-10"
+    if (sscanf(range, "%d-%d", &smin, &smax) == 1) {
+        smax = smin;
+    }
+    reuse_t* r = reuse_new(blockbits, smin, smax);
+    if (r == NULL) {
+        return -1;
+    }
+
+    while (trace_next(fp, &rec)) {
+        if (rec.op == 'I') continue;
+        reuse_access(r, rec.addr);
+        if (rec.op == 'M') {
+            reuse_access(r, rec.addr);
         }
+    }
 
-        // 得到地址 存于 number
-        getaddrfromline(buff, number);
-        sscanf(number, "%lx", &addr);
+    reuse_print(r);
+    int rc = outprefix != NULL ? reuse_write(r, outprefix) : 0;
+    reuse_free(r);
+    return rc;
+}
 
-        // 得到地址对应的 tag set
-        tag = getlownnumber(addr >> (blockbits + setsbits), tagbits);
-        set = getlownnumber(addr >> blockbits, setsbits);
+int runregions(char* regionspec, cache_t* cache, trace_t* fp, bool infoflag) {
+    regions_t* rs = region_load(regionspec);
+    long hit_count = 0, miss_count = 0, eviction_count = 0;
+    unsigned long pc = 0, victim = 0;
+    trace_rec_t rec;
 
-        // cache 行
-        long* nowptr = usedptr + set * linesperset;
+    if (rs == NULL) {
+        return -1;
+    }
 
-        long* this = nowptr;
+    while (trace_next(fp, &rec)) {
+        // 数据访问属于前一条 I 记录的指令
+        if (rec.op == 'I') {
+            pc = rec.addr;
+            continue;
+        }
 
-        bool allone = true;
-        
-        // 试图找到 tag
-        for (int i=0; i < linesperset; i++) {
-            if (*this != 0) {
-                if (*(tagptr + set * linesperset + i) == tag) {
-                    if (*(buff+1) == 'M') {
-                        print("hit hit \n");
-                        hit_count++;
-                    }
-                    else {
-                        print("hit \n");
-                    }
-                    (*this) = max++;
-                    hit_count++;
-                    goto ff;
-                }
-            }
-            else allone = false;
-            this++;
+        if (infoflag) {
+            printrec(&rec);
         }
 
-        long index = 0;
+        switch (cache_access_victim(cache, rec.addr, &victim)) {
+        case CACHE_HIT:
+            print("hit ");
+            hit_count++;
+            region_access(rs, pc, rec.addr, CACHE_HIT, 0);
+            break;
 
-        // 有空余块
-        if (allone == false) {
-            this = nowptr;
-            for (int i=0; i < linesperset; i++) {
-                if (*this == 0) {
-                    *(tagptr + set * linesperset+i) = tag;
-                    break;
-                }
-                this++;
-            }
-            *this = max++;
-            if (*(buff+1) == 'M') {
-                print("miss hit \n");
-                hit_count++;
-                *this = max++;
-            }
-            else {
-                print("miss \n");
-            }
+        case CACHE_MISS:
+            print("miss ");
             miss_count++;
-        }
+            region_access(rs, pc, rec.addr, CACHE_MISS, 0);
+            break;
 
-        // 驱逐
-        else {
-            long min = 0x7FFFFFFFFFFFFFFF;
-            this = nowptr;
-            for (int i=0; i < linesperset; i++) {
-                if (*this != 0 && ((*this) < min)) {
-                    min = *this;
-                    index = i;
-                }
-                this++;
-            }
-            *(tagptr + set *linesperset + index) = tag;
-            *(nowptr + index) = max++;
-            if (*(buff+1) == 'M') {
-                print("miss eviction hit \n");
-                hit_count++;
-            }
-            else {
-                print("miss eviction \n");
-            }
+        default:
+            print("miss eviction ");
             miss_count++;
             eviction_count++;
+            region_access(rs, pc, rec.addr, CACHE_EVICT, victim);
+            break;
+        }
+
+        if (rec.op == 'M') {
+            cache_access(cache, rec.addr);
+            print("hit ");
+            hit_count++;
+            region_access(rs, pc, rec.addr, CACHE_HIT, 0);
         }
-        ff:;
+        print("\n");
     }
 
     printf("hits:%ld ", hit_count);
     printf("misses:%ld ", miss_count);
     printf("evictions:%ld\n", eviction_count);
     printSummary(hit_count, miss_count, eviction_count);
-    free(tagptr);
-    free(usedptr);
-    fclose(fp);
+    region_print(rs);
+    region_free(rs);
     return 0;
 }
 
-void getaddrfromline(char* buff, char* result) {
-    long start = 0;
-    long end = 0;
+int runcoherence(char* cohspec, char** traces, int ntraces, int s, int E, int b,
+                 char* policy, bool infoflag) {
+    trace_t* fps[COH_MAXCORES] = {NULL};
+    long hit_count = 0, miss_count = 0, eviction_count = 0;
+    coh_t* coh = coh_new(cohspec, ntraces, s, E, b, policy);
+    int live = 0;
+    trace_rec_t rec;
 
-    for (long i=0; ; i++) {
-        if ((buff[i] == ' ') && (i != 0) &&(buff[i+1] != ' ')) {
-            start = i + 1;
+    if (coh == NULL) {
+        return -1;
+    }
+    for (int i = 0; i < ntraces; i++) {
+        if ((fps[i] = trace_open(traces[i])) == NULL) {
+            fprintf(stderr, "can not open trace file %s.\n", traces[i]);
+            for (int j = 0; j < i; j++) {
+                trace_close(fps[j]);
+            }
+            coh_free(coh);
+            return -1;
         }
-        else if (buff[i] == ',') {
-            end = i;
-            break;
+        live++;
+    }
+
+    // 轮流执行, 每个核一次重放 quantum 条数据记录
+    while (live > 0) {
+        for (int core = 0; core < ntraces; core++) {
+            int n = 0;
+            while (fps[core] != NULL && n < coh->quantum) {
+                if (!trace_next(fps[core], &rec)) {
+                    trace_close(fps[core]);
+                    fps[core] = NULL;
+                    live--;
+                    break;
+                }
+                if (rec.op == 'I') continue;
+                n++;
+
+                if (infoflag) {
+                    printf("%d: ", core);
+                    printrec(&rec);
+                }
+                switch (coh_access(coh, core, rec.op, rec.addr, rec.size)) {
+                case CACHE_HIT:
+                    print("hit ");
+                    hit_count++;
+                    break;
+
+                case CACHE_MISS:
+                    print("miss ");
+                    miss_count++;
+                    break;
+
+                default:
+                    print("miss eviction ");
+                    miss_count++;
+                    eviction_count++;
+                    break;
+                }
+                if (rec.op == 'M') {
+                    print("hit ");
+                    hit_count++;
+                }
+                print("\n");
+            }
         }
     }
-    strncpy(result, buff + start, end - start);
-}
 
-long getlownnumber(long addr, long n) {
-    long x = 1;
-    for (long i=1; i<n; i++) x = x | (x << 1);
-    return x & addr;
+    printf("hits:%ld ", hit_count);
+    printf("misses:%ld ", miss_count);
+    printf("evictions:%ld\n", eviction_count);
+    printSummary(hit_count, miss_count, eviction_count);
+    coh_print(coh);
+    coh_free(coh);
+    return 0;
 }
@@ -0,0 +1,293 @@
+/*
+ * hier.c - Multi-level write-back, write-allocate cache hierarchy
+ *
+ * A demand miss at one level fetches the block from the level below,
+ * recursively, and then installs it. Where a victim goes depends on
+ * the inclusion policy of the level below it:
+ *   nine       dirty victims are written back, clean ones dropped
+ *   inclusive  the same, and evicting from an inclusive level drops
+ *              every copy above it (back-invalidation)
+ *   exclusive  every victim from above is installed here, and a hit
+ *              here moves the block up instead of copying it
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "spec.h"
+#include "hier.h"
+
+static void install(hier_t* h, int idx, unsigned long addr, uint8_t flags);
+
+/*
+ * writeback - A dirty block leaves the tier above
+ */
+static void writeback(hier_t* h, int tier, unsigned long addr)
+{
+    hier_level_t* l;
+    long line;
+
+    if (tier >= h->ntiers) {
+        h->memwrites++;
+        return;
+    }
+    l = &h->levels[h->tierlevel[tier]];
+    line = cache_lookup(l->cache, addr);
+    if (line >= 0)
+        l->cache->flags[line] |= CACHE_F_DIRTY;
+    else
+        install(h, h->tierlevel[tier], addr, CACHE_F_DIRTY);
+}
+
+/*
+ * evicted - Dispose of a victim of level idx
+ */
+static void evicted(hier_t* h, int idx, unsigned long addr, uint8_t flags)
+{
+    hier_level_t* l = &h->levels[idx];
+    int below = l->tier + 1;
+
+    l->evictions++;
+
+    // 包含式: 上层的副本一并失效, 脏数据随之写回
+    if (l->inclusion == HIER_INCLUSIVE) {
+        for (int i = 0; i < h->nlevels; i++) {
+            uint8_t f;
+            if (h->levels[i].tier < l->tier &&
+                cache_invalidate(h->levels[i].cache, addr, &f)) {
+                l->backinvals++;
+                flags |= f;
+            }
+        }
+    }
+
+    // 排他式的下一层接收所有被驱逐的块
+    if (below < h->ntiers &&
+        h->levels[h->tierlevel[below]].inclusion == HIER_EXCLUSIVE &&
+        cache_lookup(h->levels[h->tierlevel[below]].cache, addr) < 0) {
+        if (flags & CACHE_F_DIRTY)
+            l->writebacks++;
+        install(h, h->tierlevel[below], addr, flags & CACHE_F_DIRTY);
+        return;
+    }
+
+    if (flags & CACHE_F_DIRTY) {
+        l->writebacks++;
+        writeback(h, below, addr);
+    }
+}
+
+/*
+ * install - Place a block into level idx and handle the victim. The
+ *     flags are set before the victim is processed, because writing
+ *     the victim back may reshuffle the set.
+ */
+static void install(hier_t* h, int idx, unsigned long addr, uint8_t flags)
+{
+    cache_victim_t v;
+    long line = cache_insert(h->levels[idx].cache, addr, &v);
+
+    h->levels[idx].cache->flags[line] = flags;
+    if (v.valid)
+        evicted(h, idx, v.addr, v.flags);
+}
+
+/*
+ * fetch - Supply a block to the tier above. Returns the tier that had
+ *     it, *flags tells whether the data comes back dirty (it can only
+ *     do so when it moves up out of an exclusive level).
+ */
+static int fetch(hier_t* h, int tier, unsigned long addr, uint8_t* flags)
+{
+    hier_level_t* l;
+    long line;
+    int from;
+
+    *flags = 0;
+    if (tier >= h->ntiers) {
+        h->memreads++;
+        return tier;
+    }
+
+    l = &h->levels[h->tierlevel[tier]];
+    line = cache_lookup(l->cache, addr);
+    if (line >= 0) {
+        l->hits++;
+        if (l->inclusion == HIER_EXCLUSIVE)
+            cache_invalidate(l->cache, addr, flags);
+        else
+            cache_touch(l->cache, line);
+        return tier;
+    }
+
+    l->misses++;
+    from = fetch(h, tier + 1, addr, flags);
+    if (l->inclusion != HIER_EXCLUSIVE) {
+        install(h, h->tierlevel[tier], addr, *flags & CACHE_F_DIRTY);
+        *flags = 0;
+    }
+    return from;
+}
+
+/*
+ * demand - One load or store at a first level cache
+ */
+static int demand(hier_t* h, int idx, unsigned long addr, int write)
+{
+    hier_level_t* l = &h->levels[idx];
+    long line = cache_lookup(l->cache, addr);
+    uint8_t flags;
+    int from;
+
+    if (line >= 0) {
+        l->hits++;
+        cache_touch(l->cache, line);
+        if (write)
+            l->cache->flags[line] |= CACHE_F_DIRTY;
+        return 0;
+    }
+
+    l->misses++;
+    from = fetch(h, 1, addr, &flags);
+    install(h, idx, addr, (write ? CACHE_F_DIRTY : 0) | (flags & CACHE_F_DIRTY));
+    return from;
+}
+
+int hier_access(hier_t* h, char op, unsigned long addr)
+{
+    switch (op) {
+    case 'I':
+        return h->l1i < 0 ? -1 : demand(h, h->l1i, addr, 0);
+    case 'L':
+        return demand(h, h->l1d, addr, 0);
+    case 'S':
+        return demand(h, h->l1d, addr, 1);
+    case 'M':
+        demand(h, h->l1d, addr, 0);
+        return demand(h, h->l1d, addr, 1);
+    }
+    return -1;
+}
+
+const char* hier_tier_name(hier_t* h, char op, int tier)
+{
+    if (tier >= h->ntiers)
+        return "memory";
+    if (tier > 0)
+        return h->levels[h->tierlevel[tier]].name;
+    return h->levels[op == 'I' ? h->l1i : h->l1d].name;
+}
+
+/*
+ * add_level - Parse one "name type s E b [policy] [inclusion]" row
+ */
+static int add_level(void* arg, char* row)
+{
+    hier_t* h = arg;
+    char name[16], type[4], policy[32] = "lru", incl[16] = "nine";
+    int s, E, b, n;
+    hier_level_t* l;
+
+    n = sscanf(row, "%15s %3s %d %d %d %31s %15s", name, type, &s, &E, &b,
+               policy, incl);
+    if (n < 5 || strlen(type) != 1 || strchr("idu", type[0]) == NULL) {
+        fprintf(stderr, "bad hierarchy level \"%s\", "
+                "expected: name i|d|u s E b [policy] [inclusive|exclusive|nine]\n", row);
+        return -1;
+    }
+    if (h->nlevels == HIER_MAXLEVELS) {
+        fprintf(stderr, "at most %d hierarchy levels\n", HIER_MAXLEVELS);
+        return -1;
+    }
+
+    l = &h->levels[h->nlevels];
+    strcpy(l->name, name);
+    l->type = type[0];
+    if (strcmp(incl, "inclusive") == 0)
+        l->inclusion = HIER_INCLUSIVE;
+    else if (strcmp(incl, "exclusive") == 0)
+        l->inclusion = HIER_EXCLUSIVE;
+    else if (strcmp(incl, "nine") == 0)
+        l->inclusion = HIER_NINE;
+    else {
+        fprintf(stderr, "%s: unknown inclusion policy %s\n", name, incl);
+        return -1;
+    }
+
+    // 第一层: 一个 u, 或者 i 和 d 各至多一个
+    if (l->type == 'u' || h->nlevels == 0) {
+        l->tier = h->nlevels == 0 ? 0 : h->ntiers;
+    }
+    else if (h->ntiers == 1 && h->levels[0].type != 'u' &&
+             (h->nlevels == 1 && h->levels[0].type != l->type)) {
+        l->tier = 0;
+    }
+    else {
+        fprintf(stderr, "%s: only the first level can be split\n", name);
+        return -1;
+    }
+    if (l->tier == h->ntiers)
+        h->tierlevel[h->ntiers++] = h->nlevels;
+    if (h->nlevels > 0 && b != h->levels[0].cache->b) {
+        fprintf(stderr, "%s: all levels must use the same block size\n", name);
+        return -1;
+    }
+
+    l->cache = cache_new(s, E, b, policy);
+    if (l->cache == NULL || cache_enable_flags(l->cache) < 0)
+        return -1;
+    if (l->tier == 0 && l->type != 'd')
+        h->l1i = h->nlevels;
+    if (l->tier == 0 && l->type != 'i')
+        h->l1d = h->nlevels;
+    h->nlevels++;
+    return 0;
+}
+
+/*
+ * hier_load - spec names a file if it can be opened, otherwise it is
+ *     the description itself with ';' between levels
+ */
+hier_t* hier_load(const char* spec)
+{
+    hier_t* h = calloc(1, sizeof(hier_t));
+
+    if (h == NULL)
+        return NULL;
+    h->l1i = h->l1d = -1;
+
+    if (spec_rows(spec, add_level, h) < 0) {
+        hier_free(h);
+        return NULL;
+    }
+
+    if (h->l1d < 0) {
+        fprintf(stderr, "hierarchy needs a d or u first level\n");
+        hier_free(h);
+        return NULL;
+    }
+    return h;
+}
+
+void hier_free(hier_t* h)
+{
+    if (h == NULL)
+        return;
+    for (int i = 0; i < h->nlevels; i++)
+        cache_free(h->levels[i].cache);
+    free(h);
+}
+
+void hier_print(hier_t* h)
+{
+    static const char* incl[] = {"nine", "inclusive", "exclusive"};
+
+    printf("%-8s %-10s %12s %12s %12s %12s %12s\n", "level", "inclusion",
+           "hits", "misses", "evictions", "writebacks", "backinvals");
+    for (int i = 0; i < h->nlevels; i++) {
+        hier_level_t* l = &h->levels[i];
+        printf("%-8s %-10s %12ld %12ld %12ld %12ld %12ld\n", l->name,
+               l->tier ? incl[l->inclusion] : "-", l->hits, l->misses,
+               l->evictions, l->writebacks, l->backinvals);
+    }
+    printf("memory reads:%ld writes:%ld\n", h->memreads, h->memwrites);
+}
@@ -0,0 +1,67 @@
+/*
+ * hier.h - Multi-level cache hierarchy on top of cache.c
+ *
+ * A hierarchy is described one level per line (or per ';' separated
+ * field when given inline):
+ *
+ *   name  type  s  E  b  [policy]  [inclusion]
+ *
+ * type is i (instruction), d (data) or u (unified). The first level is
+ * either a single u row or an i and/or d row; every row after it is a
+ * unified level below the previous one. inclusion (inclusive, exclusive
+ * or nine, the default) describes a level with respect to the levels
+ * above it and is ignored for the first level. All levels must use the
+ * same block size. Caches are write-back and write-allocate.
+ */
+#ifndef CACHELAB_HIER_H
+#define CACHELAB_HIER_H
+
+#include "cache.h"
+
+#define HIER_MAXLEVELS 8
+
+enum {
+    HIER_NINE = 0,
+    HIER_INCLUSIVE,
+    HIER_EXCLUSIVE
+};
+
+typedef struct hier_level {
+    char name[16];
+    char type;              /* 'i', 'd' or 'u' */
+    int tier;               /* 0 for the first level */
+    int inclusion;
+    cache_t* cache;
+    long hits;              /* demand hits and misses from the level above */
+    long misses;
+    long evictions;
+    long writebacks;        /* dirty lines written to the level below */
+    long backinvals;        /* upper copies dropped to keep inclusion */
+} hier_level_t;
+
+typedef struct hier {
+    int nlevels;
+    int ntiers;
+    hier_level_t levels[HIER_MAXLEVELS];
+    int tierlevel[HIER_MAXLEVELS];  /* level of each tier below the first */
+    int l1i, l1d;                   /* first level for I and data, -1 if none */
+    long memreads;
+    long memwrites;
+} hier_t;
+
+/* Build a hierarchy from a file name or an inline spec, NULL on error */
+hier_t* hier_load(const char* spec);
+void hier_free(hier_t* h);
+
+/*
+ * Replay one trace record. Returns the tier that supplied the data of
+ * the last access (ntiers for memory), or -1 if no level takes op.
+ */
+int hier_access(hier_t* h, char op, unsigned long addr);
+
+/* Name of a tier as returned by hier_access() */
+const char* hier_tier_name(hier_t* h, char op, int tier);
+
+void hier_print(hier_t* h);
+
+#endif /* CACHELAB_HIER_H */
@@ -0,0 +1,104 @@
+/*
+ * native.c - In-process memory tracing of the transpose functions
+ *
+ * Loads and stores are counted like lackey's L and S records, except
+ * that an access spanning several blocks, such as an unaligned 32 byte
+ * AVX2 load, counts once per block where csim-ref counts it once.
+ * Accesses outside the watched range, such as the stack, are dropped
+ * just as test-trans drops them from a valgrind trace.
+ */
+#include <stddef.h>
+#include "native.h"
+
+static cache_t* cache;
+static unsigned long lo, size;
+static long hits, misses, evictions;
+
+void native_begin(cache_t* c, const void* from, const void* to)
+{
+    lo = (unsigned long)from;
+    size = (unsigned long)to - lo;
+    hits = misses = evictions = 0;
+    cache = c;
+}
+
+void native_end(long* h, long* m, long* e)
+{
+    cache = NULL;
+    *h = hits;
+    *m = misses;
+    *e = evictions;
+}
+
+/* One access, if addr is in the watched range */
+static inline void access1(unsigned long addr)
+{
+    // 一次无符号比较同时排除低于和高于范围的地址
+    if (addr - lo >= size)
+        return;
+    switch (cache_access(cache, addr)) {
+    case CACHE_HIT:
+        hits++;
+        break;
+    case CACHE_EVICT:
+        evictions++;
+        /* fall through */
+    default:
+        misses++;
+        break;
+    }
+}
+
+/* An access of n bytes at p, once for each block it touches */
+static inline void record(const void* p, unsigned long n)
+{
+    unsigned long addr = (unsigned long)p;
+    unsigned long last = addr + (n ? n : 1) - 1;
+
+    if (cache == NULL)
+        return;
+    access1(addr);
+    for (addr = (addr >> cache->b) + 1; addr <= last >> cache->b; addr++)
+        access1(addr << cache->b);
+}
+
+/* Entry points the compiler calls in -fsanitize=thread code */
+void __tsan_init(void) {}
+void __tsan_func_entry(void* pc) {}
+void __tsan_func_exit(void) {}
+
+void __tsan_read1(void* p) { record(p, 1); }
+void __tsan_read2(void* p) { record(p, 2); }
+void __tsan_read4(void* p) { record(p, 4); }
+void __tsan_read8(void* p) { record(p, 8); }
+void __tsan_read16(void* p) { record(p, 16); }
+void __tsan_write1(void* p) { record(p, 1); }
+void __tsan_write2(void* p) { record(p, 2); }
+void __tsan_write4(void* p) { record(p, 4); }
+void __tsan_write8(void* p) { record(p, 8); }
+void __tsan_write16(void* p) { record(p, 16); }
+
+void __tsan_unaligned_read2(void* p) { record(p, 2); }
+void __tsan_unaligned_read4(void* p) { record(p, 4); }
+void __tsan_unaligned_read8(void* p) { record(p, 8); }
+void __tsan_unaligned_read16(void* p) { record(p, 16); }
+void __tsan_unaligned_write2(void* p) { record(p, 2); }
+void __tsan_unaligned_write4(void* p) { record(p, 4); }
+void __tsan_unaligned_write8(void* p) { record(p, 8); }
+void __tsan_unaligned_write16(void* p) { record(p, 16); }
+
+void __tsan_read_range(void* p, size_t n) { record(p, n); }
+void __tsan_write_range(void* p, size_t n) { record(p, n); }
+
+/* Atomics turn into calls too, which have to do the access themselves */
+int __tsan_atomic32_load(const volatile int* a, int mo)
+{
+    record((const void*)a, sizeof(*a));
+    return __atomic_load_n(a, __ATOMIC_SEQ_CST);
+}
+
+void __tsan_atomic32_store(volatile int* a, int v, int mo)
+{
+    record((void*)a, sizeof(*a));
+    __atomic_store_n(a, v, __ATOMIC_SEQ_CST);
+}
@@ -0,0 +1,30 @@
+/*
+ * native.h - In-process memory tracing of the transpose functions
+ *
+ * trans.c is compiled a second time with -fsanitize=thread, which makes
+ * the compiler call __tsan_readN/__tsan_writeN before every load and
+ * store. native.c defines those hooks without the ThreadSanitizer
+ * runtime: between native_begin() and native_end() each access that
+ * falls into the watched range goes straight into a cache.c cache, the
+ * way a filtered lackey trace would go into csim-ref.
+ *
+ * The __tsan_* entry points are the compiler's private interface to its
+ * own runtime, not a documented ABI. native.c implements the ones gcc
+ * emits today; a compiler that calls others, or changes their
+ * signatures, fails to link test-trans or traces wrongly. The counts
+ * only approximate the valgrind ones in any case: accesses the compiler
+ * does not instrument are missed, and an access spanning two blocks
+ * counts twice here but once in a lackey trace.
+ */
+#ifndef CACHELAB_NATIVE_H
+#define CACHELAB_NATIVE_H
+
+#include "cache.h"
+
+/* Start simulating the accesses to [lo, hi) on c */
+void native_begin(cache_t* c, const void* lo, const void* hi);
+
+/* Stop, and return what the accesses since native_begin() did */
+void native_end(long* hits, long* misses, long* evictions);
+
+#endif /* CACHELAB_NATIVE_H */
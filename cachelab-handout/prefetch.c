@@ -0,0 +1,265 @@
+/*
+ * prefetch.c - Hardware prefetcher models in front of a cache
+ *
+ * Demand accesses go through the line API so that prefetched lines can
+ * carry CACHE_F_PREFETCH until their first use. There is no timing: a
+ * prefetch is complete as soon as it is issued.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "prefetch.h"
+
+#define RPT_REGIONBITS  12          /* the stride table tracks 4 KiB regions */
+#define RPT_MAXCONF     3
+
+static const char* kinds[] = {"next", "stride", "stream"};
+
+prefetch_t* prefetch_new(const char* spec, cache_t* c)
+{
+    static const int defaults[][3] = {{1, 1, 0}, {1, 1, 64}, {2, 8, 8}};
+    char name[16];
+    prefetch_t* pf;
+    int n, kind;
+
+    pf = calloc(1, sizeof(prefetch_t));
+    if (pf == NULL) {
+        fprintf(stderr, "calloc error.\n");
+        return NULL;
+    }
+    n = sscanf(spec, "%15[a-z]:%d:%d:%d", name, &pf->degree, &pf->distance, &pf->entries);
+    for (kind = 0; kind < 3 && (n < 1 || strcmp(name, kinds[kind]) != 0); kind++)
+        ;
+    if (kind == 3) {
+        fprintf(stderr, "bad prefetcher %s, expected next|stride|stream[:degree[:distance[:entries]]]\n",
+                spec);
+        free(pf);
+        return NULL;
+    }
+    pf->kind = kind;
+    if (n < 2)
+        pf->degree = defaults[kind][0];
+    if (n < 3)
+        pf->distance = defaults[kind][1];
+    if (n < 4)
+        pf->entries = defaults[kind][2];
+    if (pf->degree < 1 || pf->distance < 1 || (kind != PREFETCH_NEXT && pf->entries < 1)) {
+        fprintf(stderr, "%s: degree, distance and entries must be positive\n", spec);
+        free(pf);
+        return NULL;
+    }
+
+    pf->cache = c;
+    if (cache_enable_flags(c) < 0) {
+        free(pf);
+        return NULL;
+    }
+    if (kind == PREFETCH_STRIDE)
+        pf->rpt = calloc(pf->entries, sizeof(rpt_entry_t));
+    if (kind == PREFETCH_STREAM)
+        pf->streams = calloc(pf->entries, sizeof(stream_t));
+    if ((kind == PREFETCH_STRIDE && pf->rpt == NULL) ||
+        (kind == PREFETCH_STREAM && pf->streams == NULL)) {
+        fprintf(stderr, "calloc error.\n");
+        prefetch_free(pf);
+        return NULL;
+    }
+    return pf;
+}
+
+void prefetch_free(prefetch_t* pf)
+{
+    if (pf == NULL)
+        return;
+    free(pf->rpt);
+    free(pf->streams);
+    blockmap_free(&pf->pout);
+    free(pf);
+}
+
+/* 状态: 0 空, 1 被预取挤出, 2 已回到 cache */
+static void pset_mark(prefetch_t* pf, unsigned long block)
+{
+    blockmap_put(&pf->pout, block, 1);
+}
+
+/* Returns whether block was out because of a prefetch, and clears it */
+static int pset_take(prefetch_t* pf, unsigned long block)
+{
+    if (blockmap_get(&pf->pout, block) != 1)
+        return 0;
+    blockmap_put(&pf->pout, block, 2);
+    return 1;
+}
+
+/*
+ * issue - Prefetch a block unless it is already cached
+ */
+static void issue(prefetch_t* pf, long block)
+{
+    cache_t* c = pf->cache;
+    unsigned long addr;
+    cache_victim_t v;
+    long line;
+
+    if (block < 0 || (unsigned long)block > (~0UL >> c->b))
+        return;
+    addr = (unsigned long)block << c->b;
+    if (cache_lookup(c, addr) >= 0)
+        return;
+
+    line = cache_insert(c, addr, &v);
+    c->flags[line] = CACHE_F_PREFETCH;
+    pf->issued++;
+    pset_take(pf, block);
+    if (v.valid) {
+        if (v.flags & CACHE_F_PREFETCH)
+            pf->useless++;
+        else
+            pset_mark(pf, v.addr >> c->b);
+    }
+}
+
+static void train_stride(prefetch_t* pf, unsigned long addr)
+{
+    unsigned long region = addr >> RPT_REGIONBITS;
+    rpt_entry_t* e = &pf->rpt[region % pf->entries];
+    long stride = (long)(addr - e->last);
+
+    if (e->region != region || e->last == 0) {
+        e->region = region;
+        e->last = addr;
+        e->stride = 0;
+        e->conf = 0;
+        return;
+    }
+    // 同一地址的重复访问不算一步
+    if (stride == 0)
+        return;
+
+    if (stride == e->stride) {
+        if (e->conf < RPT_MAXCONF)
+            e->conf++;
+    }
+    else if (e->conf > 0) {
+        e->conf--;
+    }
+    else {
+        e->stride = stride;
+    }
+    e->last = addr;
+
+    if (e->conf > 0) {
+        for (int k = 0; k < pf->degree; k++) {
+            long target = (long)addr + e->stride * (pf->distance + k);
+            if (target >= 0)
+                issue(pf, target >> pf->cache->b);
+        }
+    }
+}
+
+/*
+ * run_ahead - Keep a confirmed stream up to distance blocks ahead
+ */
+static void run_ahead(prefetch_t* pf, stream_t* s)
+{
+    for (int n = 0; n < pf->degree && (s->ahead - s->last) * s->dir < pf->distance; n++) {
+        s->ahead += s->dir;
+        issue(pf, s->ahead);
+    }
+}
+
+static void train_stream(prefetch_t* pf, long block, int miss)
+{
+    stream_t* victim = &pf->streams[0];
+
+    pf->now++;
+
+    // 落在已确认的流的窗口内
+    for (int i = 0; i < pf->entries; i++) {
+        stream_t* s = &pf->streams[i];
+        if (s->valid && s->dir != 0 &&
+            (block - s->last) * s->dir >= 0 && (s->ahead - block) * s->dir >= 0) {
+            s->last = block;
+            s->used = pf->now;
+            run_ahead(pf, s);
+            return;
+        }
+    }
+    if (!miss)
+        return;
+
+    // 与未确认的流相邻, 确认方向
+    for (int i = 0; i < pf->entries; i++) {
+        stream_t* s = &pf->streams[i];
+        if (s->valid && s->dir == 0 && (block == s->last + 1 || block == s->last - 1)) {
+            s->dir = block > s->last ? 1 : -1;
+            s->last = s->ahead = block;
+            s->used = pf->now;
+            run_ahead(pf, s);
+            return;
+        }
+        if (!s->valid || (victim->valid && s->used < victim->used))
+            victim = s;
+    }
+
+    victim->valid = 1;
+    victim->dir = 0;
+    victim->last = victim->ahead = block;
+    victim->used = pf->now;
+}
+
+int prefetch_access(prefetch_t* pf, unsigned long addr)
+{
+    cache_t* c = pf->cache;
+    long line = cache_lookup(c, addr);
+    int outcome, first_use = 0;
+
+    if (line >= 0) {
+        cache_touch(c, line);
+        if (c->flags[line] & CACHE_F_PREFETCH) {
+            c->flags[line] &= ~CACHE_F_PREFETCH;
+            pf->useful++;
+            first_use = 1;
+        }
+        outcome = CACHE_HIT;
+    }
+    else {
+        cache_victim_t v;
+        if (pset_take(pf, addr >> c->b))
+            pf->pollution++;
+        cache_insert(c, addr, &v);
+        outcome = v.valid ? CACHE_EVICT : CACHE_MISS;
+        if (v.valid && (v.flags & CACHE_F_PREFETCH))
+            pf->useless++;
+    }
+
+    switch (pf->kind) {
+    case PREFETCH_NEXT:
+        // 缺失或第一次用到预取的块时取后面的块
+        if (outcome != CACHE_HIT || first_use) {
+            for (int k = 0; k < pf->degree; k++)
+                issue(pf, (long)(addr >> c->b) + pf->distance + k);
+        }
+        break;
+    case PREFETCH_STRIDE:
+        train_stride(pf, addr);
+        break;
+    case PREFETCH_STREAM:
+        train_stream(pf, addr >> c->b, outcome != CACHE_HIT || first_use);
+        break;
+    }
+    return outcome;
+}
+
+void prefetch_print(prefetch_t* pf, long misses)
+{
+    printf("prefetcher:%s degree:%d distance:%d", kinds[pf->kind], pf->degree, pf->distance);
+    if (pf->kind != PREFETCH_NEXT)
+        printf(" entries:%d", pf->entries);
+    printf("\nprefetches:%ld useful:%ld useless:%ld pollution:%ld\n",
+           pf->issued, pf->useful, pf->useless, pf->pollution);
+    printf("accuracy:%.4f coverage:%.4f\n",
+           pf->issued ? (double)pf->useful / pf->issued : 0.0,
+           pf->useful + misses ? (double)pf->useful / (pf->useful + misses) : 0.0);
+}
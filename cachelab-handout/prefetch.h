@@ -0,0 +1,84 @@
+/*
+ * prefetch.h - Hardware prefetcher models in front of a cache
+ *
+ * A prefetcher is given as "kind[:degree[:distance[:entries]]]":
+ *
+ *   next     on a miss, or the first use of a prefetched line, fetch
+ *            degree blocks starting distance blocks ahead (1:1)
+ *   stride   reference prediction table of entries slots (64), indexed
+ *            by the 4 KiB region of the address; once the same stride
+ *            is seen twice, fetch degree strides starting distance
+ *            strides ahead (1:1)
+ *   stream   entries stream trackers (8), each started by two misses
+ *            to adjacent blocks; a tracker stays up to distance blocks
+ *            ahead of its stream, at most degree new blocks per access
+ *            (2:8)
+ *
+ * Prefetched blocks go into the cache itself and are flagged until a
+ * demand access uses them. The statistics are
+ *   accuracy   useful prefetches / prefetches issued
+ *   coverage   useful prefetches / (useful prefetches + demand misses)
+ *   pollution  demand misses to blocks that a prefetch had evicted
+ */
+#ifndef CACHELAB_PREFETCH_H
+#define CACHELAB_PREFETCH_H
+
+#include <stdint.h>
+#include "cache.h"
+#include "blockmap.h"
+
+enum {
+    PREFETCH_NEXT = 0,
+    PREFETCH_STRIDE,
+    PREFETCH_STREAM
+};
+
+/* One reference prediction table slot */
+typedef struct rpt_entry {
+    unsigned long region;
+    unsigned long last;     /* previous address */
+    long stride;
+    int conf;               /* 0..3, prefetch from 1 */
+} rpt_entry_t;
+
+/* One stream tracker, positions are block numbers */
+typedef struct stream {
+    int valid;
+    int dir;                /* +1 or -1 once confirmed, 0 before */
+    long last;              /* last demand block of the stream */
+    long ahead;             /* furthest block prefetched */
+    unsigned long used;     /* for replacing the least recent tracker */
+} stream_t;
+
+typedef struct prefetch {
+    int kind;
+    int degree;
+    int distance;
+    int entries;
+    cache_t* cache;
+    rpt_entry_t* rpt;
+    stream_t* streams;
+    unsigned long now;
+
+    blockmap_t pout;        /* blocks evicted by prefetches, 1 = still out */
+
+    long issued;            /* blocks brought in by prefetches */
+    long useful;            /* of those, used by a demand access */
+    long useless;           /* of those, evicted unused */
+    long pollution;
+} prefetch_t;
+
+/* Attach a prefetcher described by spec to c, NULL on error */
+prefetch_t* prefetch_new(const char* spec, cache_t* c);
+void prefetch_free(prefetch_t* pf);
+
+/*
+ * One demand access through the cache, followed by whatever the
+ * prefetcher issues. Returns CACHE_HIT, CACHE_MISS or CACHE_EVICT for
+ * the demand access.
+ */
+int prefetch_access(prefetch_t* pf, unsigned long addr);
+
+void prefetch_print(prefetch_t* pf, long misses);
+
+#endif /* CACHELAB_PREFETCH_H */
@@ -0,0 +1,204 @@
+/*
+ * region.c - Attribute cache behaviour to address regions
+ *
+ * Lookups remember the region of the previous access, which is where
+ * most accesses of a loop nest land, and fall back to a binary search
+ * over the sorted starts.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "spec.h"
+#include "cache.h"
+#include "region.h"
+
+/*
+ * find - Index of the region containing addr, l->n if there is none
+ */
+static inline int find(region_list_t* l, unsigned long addr)
+{
+    int lo = 0, hi = l->n;
+
+    if (l->r[l->last].start <= addr && addr < l->r[l->last].end)
+        return l->last;
+
+    // 最后一个 start <= addr 的区域
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (l->r[mid].start <= addr)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo > 0 && addr < l->r[lo - 1].end)
+        return l->last = lo - 1;
+    return l->n;
+}
+
+static void count(region_t* r, int outcome)
+{
+    switch (outcome) {
+    case CACHE_HIT:
+        r->hits++;
+        break;
+    case CACHE_EVICT:
+        r->evictions++;
+        /* fall through */
+    default:
+        r->misses++;
+        break;
+    }
+}
+
+void region_access(regions_t* rs, unsigned long pc, unsigned long addr,
+                   int outcome, unsigned long victim)
+{
+    int d = find(&rs->data, addr);
+
+    count(&rs->data.r[d], outcome);
+    if (rs->code.n > 0)
+        count(&rs->code.r[find(&rs->code, pc)], outcome);
+    if (outcome == CACHE_EVICT)
+        rs->conflicts[d][find(&rs->data, victim)]++;
+}
+
+/*
+ * add_region - Parse one "name start end [data|code]" row
+ */
+static int add_region(void* arg, char* row)
+{
+    regions_t* rs = arg;
+    char name[32], start[32], end[32], kind[8] = "data";
+    region_list_t* l;
+    region_t* r;
+    char* p;
+    char* q;
+
+    if (sscanf(row, "%31s %31s %31s %7s", name, start, end, kind) < 3 ||
+        (strcmp(kind, "data") != 0 && strcmp(kind, "code") != 0)) {
+        fprintf(stderr, "bad region \"%s\", expected: name start end [data|code]\n", row);
+        return -1;
+    }
+    l = kind[0] == 'c' ? &rs->code : &rs->data;
+    if (l->n == REGION_MAX) {
+        fprintf(stderr, "at most %d %s regions\n", REGION_MAX, kind);
+        return -1;
+    }
+
+    r = &l->r[l->n];
+    strcpy(r->name, name);
+    r->start = strtoul(start, &p, 0);
+    r->end = strtoul(end, &q, 0);
+    if (*p != '\0' || *q != '\0' || r->end <= r->start) {
+        fprintf(stderr, "%s: bad range %s %s\n", name, start, end);
+        return -1;
+    }
+    l->n++;
+    return 0;
+}
+
+static int by_start(const void* a, const void* b)
+{
+    const region_t* x = a;
+    const region_t* y = b;
+
+    return x->start < y->start ? -1 : x->start > y->start;
+}
+
+/*
+ * finish - Sort a list, reject overlaps and name the catch-all slot
+ */
+static int finish(region_list_t* l, const char* kind)
+{
+    qsort(l->r, l->n, sizeof(region_t), by_start);
+    for (int i = 1; i < l->n; i++) {
+        if (l->r[i].start < l->r[i - 1].end) {
+            fprintf(stderr, "%s regions %s and %s overlap\n", kind,
+                    l->r[i - 1].name, l->r[i].name);
+            return -1;
+        }
+    }
+    strcpy(l->r[l->n].name, "other");
+    l->last = l->n;
+    return 0;
+}
+
+regions_t* region_load(const char* spec)
+{
+    regions_t* rs = calloc(1, sizeof(regions_t));
+
+    if (rs == NULL)
+        return NULL;
+
+    if (spec_rows(spec, add_region, rs) < 0) {
+        free(rs);
+        return NULL;
+    }
+
+    if (finish(&rs->data, "data") < 0 || finish(&rs->code, "code") < 0) {
+        free(rs);
+        return NULL;
+    }
+    return rs;
+}
+
+void region_free(regions_t* rs)
+{
+    free(rs);
+}
+
+static void print_list(region_list_t* l, const char* kind)
+{
+    printf("%-16s %16s %16s %10s %10s %10s\n", kind, "start", "end",
+           "hits", "misses", "evictions");
+    for (int i = 0; i <= l->n; i++) {
+        region_t* r = &l->r[i];
+        if (i == l->n && r->hits + r->misses == 0)
+            continue;
+        if (i < l->n)
+            printf("%-16s %16lx %16lx", r->name, r->start, r->end);
+        else
+            printf("%-16s %16s %16s", r->name, "-", "-");
+        printf(" %10ld %10ld %10ld\n", r->hits, r->misses, r->evictions);
+    }
+}
+
+typedef struct pair {
+    int incoming, victim;
+    long count;
+} pair_t;
+
+static int by_count(const void* a, const void* b)
+{
+    const pair_t* x = a;
+    const pair_t* y = b;
+
+    return x->count > y->count ? -1 : x->count < y->count;
+}
+
+void region_print(regions_t* rs)
+{
+    static pair_t pairs[(REGION_MAX + 1) * (REGION_MAX + 1)];
+    int n = 0;
+
+    print_list(&rs->data, "data region");
+    if (rs->code.n > 0)
+        print_list(&rs->code, "code region");
+
+    // 冲突对按次数从多到少
+    for (int i = 0; i <= rs->data.n; i++) {
+        for (int j = 0; j <= rs->data.n; j++) {
+            if (rs->conflicts[i][j] > 0) {
+                pairs[n].incoming = i;
+                pairs[n].victim = j;
+                pairs[n].count = rs->conflicts[i][j];
+                n++;
+            }
+        }
+    }
+    qsort(pairs, n, sizeof(pair_t), by_count);
+    printf("%-16s %-16s %10s\n", "incoming", "evicts", "conflicts");
+    for (int k = 0; k < n; k++)
+        printf("%-16s %-16s %10ld\n", rs->data.r[pairs[k].incoming].name,
+               rs->data.r[pairs[k].victim].name, pairs[k].count);
+}
@@ -0,0 +1,60 @@
+/*
+ * region.h - Attribute cache behaviour to address regions
+ *
+ * Regions are described one per line (or per ';' separated field when
+ * given inline):
+ *
+ *   name  start  end  [data|code]
+ *
+ * start and end are C integer literals, the region is [start, end).
+ * A data region collects the accesses whose address falls into it, a
+ * code region the accesses made by instructions inside it (the PC is
+ * taken from the I record preceding each access in a lackey trace).
+ * Regions of one kind must not overlap. tracegen writes the ranges of
+ * its A and B matrices to .regions in this format.
+ *
+ * Besides hits, misses and evictions per region, every eviction is
+ * counted as a conflict pair: the data region of the incoming block
+ * against the data region of the victim.
+ */
+#ifndef CACHELAB_REGION_H
+#define CACHELAB_REGION_H
+
+#define REGION_MAX 64
+
+typedef struct region {
+    char name[32];
+    unsigned long start;
+    unsigned long end;
+    long hits;
+    long misses;
+    long evictions;
+} region_t;
+
+/* Regions of one kind sorted by start, plus a last slot for the rest */
+typedef struct region_list {
+    int n;
+    int last;               /* index of the previous match */
+    region_t r[REGION_MAX + 1];
+} region_list_t;
+
+typedef struct regions {
+    region_list_t data;
+    region_list_t code;
+    long conflicts[REGION_MAX + 1][REGION_MAX + 1];    /* [incoming][victim] */
+} regions_t;
+
+/* spec names a file if it can be opened, otherwise it is the text */
+regions_t* region_load(const char* spec);
+void region_free(regions_t* rs);
+
+/*
+ * Record the outcome (CACHE_HIT, CACHE_MISS or CACHE_EVICT) of one
+ * access to addr made at pc; victim is the evicted block address.
+ */
+void region_access(regions_t* rs, unsigned long pc, unsigned long addr,
+                   int outcome, unsigned long victim);
+
+void region_print(regions_t* rs);
+
+#endif /* CACHELAB_REGION_H */
@@ -0,0 +1,334 @@
+/*
+ * reuse.c - One-pass LRU stack distance profiler
+ *
+ * Every block has one node per set count in an order statistic treap
+ * keyed by (set, time of last access). The stack distance of an access
+ * is then the number of keys of the same set that are newer than the
+ * block's own, which is two rank queries, after which the node moves
+ * to the current time. Each access costs O(log blocks) per set count,
+ * except re-touching the most recent block of a set: its distance is 0
+ * and its new key sorts in the same place, so it is updated in place.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "reuse.h"
+
+#define REUSE_TIMEBITS  40
+#define REUSE_MAXS      (64 - REUSE_TIMEBITS)
+
+static uint32_t rng = 2463534242u;
+
+static uint32_t next_prio(void)
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng;
+}
+
+/* Treap primitives, node 0 is the empty tree */
+static inline void update(reuse_tree_t* t, uint32_t n)
+{
+    t->size[n] = 1 + t->size[t->left[n]] + t->size[t->right[n]];
+}
+
+/* Split n into keys < key and keys >= key */
+static void split(reuse_tree_t* t, uint32_t n, uint64_t key, uint32_t* l, uint32_t* r)
+{
+    if (n == 0) {
+        *l = *r = 0;
+        return;
+    }
+    if (t->key[n] < key) {
+        split(t, t->right[n], key, &t->right[n], r);
+        *l = n;
+    }
+    else {
+        split(t, t->left[n], key, l, &t->left[n]);
+        *r = n;
+    }
+    update(t, n);
+}
+
+static uint32_t merge(reuse_tree_t* t, const uint32_t* prio, uint32_t a, uint32_t b)
+{
+    if (a == 0)
+        return b;
+    if (b == 0)
+        return a;
+    if (prio[a] > prio[b]) {
+        t->right[a] = merge(t, prio, t->right[a], b);
+        update(t, a);
+        return a;
+    }
+    t->left[b] = merge(t, prio, a, t->left[b]);
+    update(t, b);
+    return b;
+}
+
+/* Number of keys smaller than key */
+static long count_less(reuse_tree_t* t, uint64_t key)
+{
+    uint32_t n = t->root;
+    long cnt = 0;
+
+    while (n) {
+        if (t->key[n] < key) {
+            cnt += t->size[t->left[n]] + 1;
+            n = t->right[n];
+        }
+        else {
+            n = t->left[n];
+        }
+    }
+    return cnt;
+}
+
+static void insert(reuse_tree_t* t, const uint32_t* prio, uint32_t id)
+{
+    uint32_t l, r;
+
+    t->left[id] = t->right[id] = 0;
+    t->size[id] = 1;
+    split(t, t->root, t->key[id], &l, &r);
+    t->root = merge(t, prio, merge(t, prio, l, id), r);
+}
+
+static void erase(reuse_tree_t* t, const uint32_t* prio, uint32_t id)
+{
+    uint32_t l, m, r;
+
+    split(t, t->root, t->key[id], &l, &r);
+    split(t, r, t->key[id] + 1, &m, &r);
+    t->root = merge(t, prio, l, r);
+}
+
+reuse_t* reuse_new(int b, int smin, int smax)
+{
+    reuse_t* r;
+
+    if (b < 0 || smin < 0 || smax < smin || smax > REUSE_MAXS || smax + b >= 64) {
+        fprintf(stderr, "bad reuse profile b=%d s=%d-%d, s can be at most %d\n",
+                b, smin, smax, REUSE_MAXS);
+        return NULL;
+    }
+    r = calloc(1, sizeof(reuse_t));
+    if (r == NULL)
+        return NULL;
+    r->b = b;
+    r->smin = smin;
+    r->smax = smax;
+    r->trees = calloc(smax - smin + 1, sizeof(reuse_tree_t));
+    if (r->trees == NULL) {
+        free(r);
+        return NULL;
+    }
+    for (int s = smin; s <= smax; s++) {
+        r->trees[s - smin].mru = calloc(1UL << s, sizeof(uint32_t));
+        if (r->trees[s - smin].mru == NULL) {
+            fprintf(stderr, "calloc error.\n");
+            reuse_free(r);
+            return NULL;
+        }
+    }
+    return r;
+}
+
+void reuse_free(reuse_t* r)
+{
+    if (r == NULL)
+        return;
+    for (int i = 0; i <= r->smax - r->smin; i++) {
+        reuse_tree_t* t = &r->trees[i];
+        free(t->key);
+        free(t->left);
+        free(t->right);
+        free(t->size);
+        free(t->mru);
+        free(t->hist);
+    }
+    free(r->trees);
+    blockmap_free(&r->map);
+    free(r->block);
+    free(r->prio);
+    free(r);
+}
+
+static void* grow(void* p, size_t n, size_t elem)
+{
+    p = realloc(p, n * elem);
+    if (p == NULL) {
+        fprintf(stderr, "realloc error.\n");
+        exit(1);
+    }
+    return p;
+}
+
+/*
+ * new_block - Give block an id and room in every tree
+ */
+static uint32_t new_block(reuse_t* r, unsigned long block)
+{
+    uint32_t id;
+
+    id = ++r->nblocks;
+    if (id >= r->cap) {
+        r->cap = r->cap ? 2 * r->cap : 1024;
+        r->block = grow(r->block, r->cap, sizeof(unsigned long));
+        r->prio = grow(r->prio, r->cap, sizeof(uint32_t));
+        for (int i = 0; i <= r->smax - r->smin; i++) {
+            reuse_tree_t* t = &r->trees[i];
+            t->key = grow(t->key, r->cap, sizeof(uint64_t));
+            t->left = grow(t->left, r->cap, sizeof(uint32_t));
+            t->right = grow(t->right, r->cap, sizeof(uint32_t));
+            t->size = grow(t->size, r->cap, sizeof(uint32_t));
+            t->size[0] = 0;
+        }
+    }
+    blockmap_put(&r->map, block, id);
+    r->block[id] = block;
+    r->prio[id] = next_prio();
+    return id;
+}
+
+static void add_hist(reuse_tree_t* t, long d)
+{
+    if (d >= t->histcap) {
+        long cap = t->histcap ? t->histcap : 64;
+        while (cap <= d)
+            cap *= 2;
+        t->hist = grow(t->hist, cap, sizeof(long));
+        memset(t->hist + t->histcap, 0, (cap - t->histcap) * sizeof(long));
+        t->histcap = cap;
+    }
+    t->hist[d]++;
+    if (d > t->maxd)
+        t->maxd = d;
+}
+
+void reuse_access(reuse_t* r, unsigned long addr)
+{
+    unsigned long block = addr >> r->b;
+    uint32_t id = blockmap_get(&r->map, block);
+    int fresh = id == 0;
+
+    if (fresh) {
+        id = new_block(r, block);
+        r->cold++;
+    }
+
+    for (int s = r->smin; s <= r->smax; s++) {
+        reuse_tree_t* t = &r->trees[s - r->smin];
+        uint64_t set = block & ((1UL << s) - 1);
+        uint64_t key = set << REUSE_TIMEBITS | r->now;
+
+        // 组内最近访问的块, 距离为 0, 在树中的位置不变
+        if (t->mru[set] == id) {
+            add_hist(t, 0);
+            t->key[id] = key;
+            continue;
+        }
+
+        // 同组中比自己更新的块数即栈距离
+        if (!fresh) {
+            add_hist(t, count_less(t, key) - count_less(t, t->key[id]) - 1);
+            erase(t, r->prio, id);
+        }
+        t->key[id] = key;
+        insert(t, r->prio, id);
+        t->mru[set] = id;
+    }
+    r->now++;
+}
+
+long reuse_misses(reuse_t* r, int s, long E)
+{
+    reuse_tree_t* t = &r->trees[s - r->smin];
+    long misses = r->now - r->cold;
+
+    for (long d = 0; d < E && d <= t->maxd && d < t->histcap; d++)
+        misses -= t->hist[d];
+    return misses + r->cold;
+}
+
+void reuse_print(reuse_t* r)
+{
+    printf("accesses:%lu distinct blocks:%ld block size:%d\n",
+           (unsigned long)r->now, r->cold, 1 << r->b);
+    for (int s = r->smin; s <= r->smax; s++) {
+        reuse_tree_t* t = &r->trees[s - r->smin];
+        printf("s=%d\n%10s %14s %12s %10s\n", s, "E", "size", "misses", "ratio");
+        for (long E = 1; ; E *= 2) {
+            long misses = reuse_misses(r, s, E);
+            printf("%10ld %14lu %12ld %10.6f\n", E, (unsigned long)E << (s + r->b),
+                   misses, r->now ? (double)misses / r->now : 0.0);
+            if (E > t->maxd)
+                break;
+        }
+    }
+}
+
+int reuse_write(reuse_t* r, const char* prefix)
+{
+    char name[1024];
+    FILE* hist;
+    FILE* mrc;
+    FILE* gp;
+    int n = r->smax - r->smin + 1;
+
+    snprintf(name, sizeof(name), "%s.hist", prefix);
+    hist = fopen(name, "w");
+    snprintf(name, sizeof(name), "%s.mrc", prefix);
+    mrc = fopen(name, "w");
+    snprintf(name, sizeof(name), "%s.gp", prefix);
+    gp = fopen(name, "w");
+    if (hist == NULL || mrc == NULL || gp == NULL) {
+        perror(name);
+        if (hist)
+            fclose(hist);
+        if (mrc)
+            fclose(mrc);
+        if (gp)
+            fclose(gp);
+        return -1;
+    }
+
+    fprintf(hist, "# s distance count, distance inf counts first touches\n");
+    fprintf(mrc, "# s E size misses miss_ratio, one block per s, E where the curve drops\n");
+    for (int s = r->smin; s <= r->smax; s++) {
+        reuse_tree_t* t = &r->trees[s - r->smin];
+        long misses = r->now;
+
+        for (long d = 0; d <= t->maxd && d < t->histcap; d++) {
+            if (t->hist[d])
+                fprintf(hist, "%d %ld %ld\n", s, d, t->hist[d]);
+        }
+        fprintf(hist, "%d inf %ld\n", s, r->cold);
+
+        // 命中条件为距离 < E, 曲线只在 hist[E-1] > 0 处下降
+        for (long E = 1; E <= t->maxd + 1; E++) {
+            if (E > 1 && (E - 1 >= t->histcap || t->hist[E - 1] == 0))
+                continue;
+            misses = reuse_misses(r, s, E);
+            fprintf(mrc, "%d %ld %lu %ld %.6f\n", s, E, (unsigned long)E << (s + r->b),
+                    misses, r->now ? (double)misses / r->now : 0.0);
+        }
+        fprintf(mrc, "\n\n");
+    }
+
+    fprintf(gp, "# gnuplot %s.gp\n", prefix);
+    fprintf(gp, "set logscale x 2\n");
+    fprintf(gp, "set xlabel \"cache size (bytes)\"\n");
+    fprintf(gp, "set ylabel \"miss ratio\"\n");
+    fprintf(gp, "set yrange [0:*]\n");
+    fprintf(gp, "set key top right\n");
+    fprintf(gp, "plot for [i=0:%d] '%s.mrc' index i using 3:5 with steps title sprintf(\"s=%%d\", i+%d)\n",
+            n - 1, prefix, r->smin);
+    fprintf(gp, "pause mouse close\n");
+
+    fclose(hist);
+    fclose(mrc);
+    fclose(gp);
+    return 0;
+}
@@ -0,0 +1,65 @@
+/*
+ * reuse.h - One-pass LRU stack distance profiler
+ *
+ * For every set count 2^s in a range, the stack distance of an access
+ * is the number of distinct blocks of the same set referenced since the
+ * previous access to its block. An LRU cache with 2^s sets of E lines
+ * hits exactly the accesses whose distance is below E, so the distance
+ * histograms give the miss ratio curve of every E at once (Mattson et
+ * al., 1970).
+ */
+#ifndef CACHELAB_REUSE_H
+#define CACHELAB_REUSE_H
+
+#include <stdint.h>
+#include "blockmap.h"
+
+typedef struct reuse_tree {
+    uint32_t root;
+    uint64_t* key;          /* per block, set << REUSE_TIMEBITS | last time */
+    uint32_t* left;
+    uint32_t* right;
+    uint32_t* size;
+    uint32_t* mru;          /* per set, block accessed last */
+    long* hist;             /* hist[d], accesses at stack distance d */
+    long histcap;
+    long maxd;              /* largest distance seen */
+} reuse_tree_t;
+
+typedef struct reuse {
+    int b;
+    int smin, smax;
+    uint64_t now;           /* number of accesses so far */
+    long cold;              /* first touches, misses for every cache */
+
+    blockmap_t map;         /* block address -> block id */
+
+    /* per block id, ids start at 1 */
+    uint32_t nblocks;
+    uint32_t cap;
+    unsigned long* block;
+    uint32_t* prio;
+
+    reuse_tree_t* trees;    /* one per s in smin .. smax */
+} reuse_t;
+
+/* Profile caches with 2^b byte blocks and smin..smax set index bits */
+reuse_t* reuse_new(int b, int smin, int smax);
+void reuse_free(reuse_t* r);
+
+void reuse_access(reuse_t* r, unsigned long addr);
+
+/* Number of misses of an LRU cache with 2^s sets of E lines */
+long reuse_misses(reuse_t* r, int s, long E);
+
+/* Miss ratios at power of two associativities, to stdout */
+void reuse_print(reuse_t* r);
+
+/*
+ * Write <prefix>.hist (distance histograms), <prefix>.mrc (the miss
+ * ratio curves, one gnuplot data block per s) and <prefix>.gp, a
+ * gnuplot script that plots them. Returns -1 on error.
+ */
+int reuse_write(reuse_t* r, const char* prefix);
+
+#endif /* CACHELAB_REUSE_H */
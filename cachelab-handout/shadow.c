@@ -0,0 +1,116 @@
+/*
+ * shadow.c - Compulsory / capacity / conflict miss classification
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "shadow.h"
+
+shadow_t* shadow_new(int b, unsigned long lines)
+{
+    shadow_t* sh = calloc(1, sizeof(shadow_t));
+
+    if (sh == NULL) {
+        fprintf(stderr, "calloc error.\n");
+        return NULL;
+    }
+    sh->b = b;
+    sh->lines = lines;
+    return sh;
+}
+
+void shadow_free(shadow_t* sh)
+{
+    if (sh == NULL)
+        return;
+    blockmap_free(&sh->map);
+    free(sh->prev);
+    free(sh->next);
+    free(sh->in);
+    free(sh);
+}
+
+static void* grow(void* p, size_t n, size_t elem)
+{
+    p = realloc(p, n * elem);
+    if (p == NULL) {
+        fprintf(stderr, "realloc error.\n");
+        exit(1);
+    }
+    return p;
+}
+
+/*
+ * new_block - Give block an id, it starts out not resident
+ */
+static uint32_t new_block(shadow_t* sh, unsigned long block)
+{
+    uint32_t id;
+
+    id = ++sh->nblocks;
+    if (id >= sh->cap) {
+        sh->cap = sh->cap ? 2 * sh->cap : 1024;
+        sh->prev = grow(sh->prev, sh->cap, sizeof(uint32_t));
+        sh->next = grow(sh->next, sh->cap, sizeof(uint32_t));
+        sh->in = grow(sh->in, sh->cap, sizeof(uint8_t));
+    }
+    blockmap_put(&sh->map, block, id);
+    sh->in[id] = 0;
+    return id;
+}
+
+static inline void unlink_block(shadow_t* sh, uint32_t id)
+{
+    if (sh->prev[id])
+        sh->next[sh->prev[id]] = sh->next[id];
+    else
+        sh->head = sh->next[id];
+    if (sh->next[id])
+        sh->prev[sh->next[id]] = sh->prev[id];
+    else
+        sh->tail = sh->prev[id];
+}
+
+static inline void push_front(shadow_t* sh, uint32_t id)
+{
+    sh->prev[id] = 0;
+    sh->next[id] = sh->head;
+    if (sh->head)
+        sh->prev[sh->head] = id;
+    else
+        sh->tail = id;
+    sh->head = id;
+}
+
+int shadow_access(shadow_t* sh, unsigned long addr)
+{
+    unsigned long block = addr >> sh->b;
+    uint32_t id = blockmap_get(&sh->map, block);
+    int outcome;
+
+    if (id == 0) {
+        id = new_block(sh, block);
+        outcome = SHADOW_COLD;
+    }
+    else if (sh->in[id]) {
+        if (sh->head != id) {
+            unlink_block(sh, id);
+            push_front(sh, id);
+        }
+        return SHADOW_HIT;
+    }
+    else {
+        outcome = SHADOW_MISS;
+    }
+
+    // 满了就淘汰最久未用的块
+    if (sh->resident == sh->lines) {
+        uint32_t lru = sh->tail;
+        unlink_block(sh, lru);
+        sh->in[lru] = 0;
+        sh->resident--;
+    }
+    push_front(sh, id);
+    sh->in[id] = 1;
+    sh->resident++;
+    return outcome;
+}
@@ -0,0 +1,67 @@
+/*
+ * shadow.h - Compulsory / capacity / conflict miss classification
+ *
+ * A miss of the simulated cache is
+ *   compulsory  if its block was never referenced before,
+ *   capacity    if a fully associative LRU cache of the same number of
+ *               lines would have missed as well,
+ *   conflict    otherwise: only the set mapping made it miss.
+ * The shadow keeps every block it has seen in one hash table; the
+ * blocks a fully associative cache would hold form an LRU list through
+ * the same entries, so each access costs one hash lookup.
+ */
+#ifndef CACHELAB_SHADOW_H
+#define CACHELAB_SHADOW_H
+
+#include <stdint.h>
+#include "blockmap.h"
+
+/* Outcome of an access in the shadow cache */
+enum {
+    SHADOW_HIT = 0,
+    SHADOW_MISS,            /* seen before but no longer resident */
+    SHADOW_COLD             /* first reference to the block */
+};
+
+typedef struct shadow {
+    int b;
+    unsigned long lines;    /* capacity of the fully associative cache */
+    unsigned long resident; /* blocks currently in it */
+
+    blockmap_t map;         /* block address -> block id */
+
+    /* per block id, ids start at 1; 0 ends the LRU list */
+    uint32_t nblocks;
+    uint32_t cap;
+    uint32_t* prev;
+    uint32_t* next;
+    uint8_t* in;            /* resident in the shadow cache */
+    uint32_t head, tail;    /* most and least recently used */
+
+    long compulsory;
+    long capacity;
+    long conflict;
+} shadow_t;
+
+/* Shadow of a cache with lines lines of 2^b bytes */
+shadow_t* shadow_new(int b, unsigned long lines);
+void shadow_free(shadow_t* sh);
+
+/* Simulate one access, returns SHADOW_HIT, SHADOW_MISS or SHADOW_COLD */
+int shadow_access(shadow_t* sh, unsigned long addr);
+
+/*
+ * Count a miss of the real cache, given what the shadow returned for
+ * the same access
+ */
+static inline void shadow_classify(shadow_t* sh, int outcome)
+{
+    if (outcome == SHADOW_COLD)
+        sh->compulsory++;
+    else if (outcome == SHADOW_MISS)
+        sh->capacity++;
+    else
+        sh->conflict++;
+}
+
+#endif /* CACHELAB_SHADOW_H */
@@ -0,0 +1,213 @@
+/*
+ * shard.c - Simulate one cache with its sets divided between threads
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+#include "shard.h"
+
+#define SHARD_RING      (1 << 14)   /* addresses per ring, a power of 2 */
+#define SHARD_PUBLISH   256         /* addresses between head updates */
+#define SHARD_CHUNKBITS 5           /* 32 sets per chunk keeps workers
+                                       off each other's host lines */
+#define SHARD_TABLE     256         /* chunk -> worker table size */
+
+/* Indices only grow; each is written by one side and read by the other */
+typedef struct ring {
+    unsigned long head;             /* written by the reader */
+    char pad1[64 - sizeof(unsigned long)];
+    unsigned long tail;             /* written by the worker */
+    char pad2[64 - sizeof(unsigned long)];
+    unsigned long addr[SHARD_RING];
+} ring_t;
+
+typedef struct shard {
+    pthread_t tid;
+    cache_t* cache;
+    ring_t* ring;
+    int* done;
+    int serial;                     /* no thread, the reader simulates
+                                       these sets itself */
+    long hits, misses, evictions;
+
+    /* reader side */
+    unsigned long pend;             /* head not yet published */
+    unsigned long tail;             /* last tail seen */
+} shard_t;
+
+static void* worker_main(void* arg)
+{
+    shard_t* w = arg;
+    ring_t* rg = w->ring;
+    cache_t* c = w->cache;
+    unsigned long tail = 0;
+    long hits = 0, misses = 0, evictions = 0;
+
+    for (;;) {
+        // 先读 done: 它为真时 head 已是最终值
+        int done = __atomic_load_n(w->done, __ATOMIC_ACQUIRE);
+        unsigned long head = __atomic_load_n(&rg->head, __ATOMIC_ACQUIRE);
+
+        if (head == tail) {
+            if (done)
+                break;
+            sched_yield();
+            continue;
+        }
+        for (; tail != head; tail++) {
+            switch (cache_access(c, rg->addr[tail & (SHARD_RING - 1)])) {
+            case CACHE_HIT:
+                hits++;
+                break;
+            case CACHE_EVICT:
+                evictions++;
+                /* fall through */
+            default:
+                misses++;
+                break;
+            }
+        }
+        __atomic_store_n(&rg->tail, tail, __ATOMIC_RELEASE);
+    }
+    w->hits = hits;
+    w->misses = misses;
+    w->evictions = evictions;
+    return NULL;
+}
+
+static inline void publish(shard_t* w)
+{
+    __atomic_store_n(&w->ring->head, w->pend, __ATOMIC_RELEASE);
+}
+
+static inline void push(shard_t* w, unsigned long addr)
+{
+    if (w->serial) {
+        switch (cache_access(w->cache, addr)) {
+        case CACHE_HIT:
+            w->hits++;
+            break;
+        case CACHE_EVICT:
+            w->evictions++;
+            /* fall through */
+        default:
+            w->misses++;
+            break;
+        }
+        return;
+    }
+
+    // 环满时先把已写入的交给 worker, 再等它腾出位置
+    if (w->pend - w->tail == SHARD_RING) {
+        publish(w);
+        while ((w->tail = __atomic_load_n(&w->ring->tail, __ATOMIC_ACQUIRE))
+               == w->pend - SHARD_RING)
+            sched_yield();
+    }
+    w->ring->addr[w->pend & (SHARD_RING - 1)] = addr;
+    if (++w->pend % SHARD_PUBLISH == 0)
+        publish(w);
+}
+
+/*
+ * drain - Wait until every worker has caught up with the reader
+ */
+static void drain(shard_t* ws, int nthreads)
+{
+    for (int i = 0; i < nthreads; i++) {
+        publish(&ws[i]);
+        while ((ws[i].tail = __atomic_load_n(&ws[i].ring->tail, __ATOMIC_ACQUIRE))
+               != ws[i].pend)
+            sched_yield();
+    }
+}
+
+int shard_run(cache_t* c, trace_t* t, int nthreads,
+              long* hits, long* misses, long* evictions)
+{
+    unsigned char owner[SHARD_TABLE];
+    int chunkbits = SHARD_CHUNKBITS;
+    unsigned long nchunks, tabmask;
+    shard_t* ws;
+    trace_rec_t rec;
+    int done = 0, failed = 0;
+
+    // 组太少时缩小块, 仍不够就减少线程
+    while (chunkbits > 0 && (c->nsets >> chunkbits) < (unsigned long)nthreads)
+        chunkbits--;
+    nchunks = c->nsets >> chunkbits;
+    if ((unsigned long)nthreads > nchunks)
+        nthreads = nchunks;
+    if (nthreads > SHARD_TABLE)
+        nthreads = SHARD_TABLE;
+    tabmask = (nchunks < SHARD_TABLE ? nchunks : SHARD_TABLE) - 1;
+    for (int i = 0; i < SHARD_TABLE; i++)
+        owner[i] = i % nthreads;
+
+    ws = calloc(nthreads, sizeof(shard_t));
+    if (ws == NULL) {
+        fprintf(stderr, "calloc error.\n");
+        return -1;
+    }
+    for (int i = 0; i < nthreads; i++) {
+        if (posix_memalign((void**)&ws[i].ring, 64, sizeof(ring_t)) != 0) {
+            fprintf(stderr, "posix_memalign error.\n");
+            while (i-- > 0) {
+                __atomic_store_n(&done, 1, __ATOMIC_RELEASE);
+                if (!ws[i].serial)
+                    pthread_join(ws[i].tid, NULL);
+                free(ws[i].ring);
+            }
+            free(ws);
+            return -1;
+        }
+        ws[i].ring->head = ws[i].ring->tail = 0;
+        ws[i].cache = c;
+        ws[i].done = &done;
+        // 建不了线程就由读 trace 的线程自己模拟这些组, 结果不变
+        if (pthread_create(&ws[i].tid, NULL, worker_main, &ws[i]) != 0) {
+            if (!failed)
+                fprintf(stderr, "shard: pthread_create failed, simulating in the reader\n");
+            failed = 1;
+            ws[i].serial = 1;
+        }
+    }
+
+    // 按组所在的块轮流分给各线程, M 拆成两次访问
+    while (trace_next(t, &rec)) {
+        unsigned long set;
+        shard_t* w;
+
+        if (rec.op == 'I')
+            continue;
+
+        // tag 放宽会重排整个 cache, 只能在所有 worker 空闲时进行
+        if (!cache_fits(c, rec.addr)) {
+            drain(ws, nthreads);
+            if (cache_widen(c, rec.addr) < 0)
+                exit(1);
+        }
+        set = (rec.addr >> c->b) & c->setmask;
+        w = &ws[owner[(set >> chunkbits) & tabmask]];
+        push(w, rec.addr);
+        if (rec.op == 'M')
+            push(w, rec.addr);
+    }
+
+    for (int i = 0; i < nthreads; i++)
+        publish(&ws[i]);
+    __atomic_store_n(&done, 1, __ATOMIC_RELEASE);
+
+    for (int i = 0; i < nthreads; i++) {
+        if (!ws[i].serial)
+            pthread_join(ws[i].tid, NULL);
+        *hits += ws[i].hits;
+        *misses += ws[i].misses;
+        *evictions += ws[i].evictions;
+        free(ws[i].ring);
+    }
+    free(ws);
+    return 0;
+}
@@ -0,0 +1,26 @@
+/*
+ * shard.h - Simulate one cache with its sets divided between threads
+ *
+ * Sets never interact, so each worker thread can own a disjoint group
+ * of sets of the same cache_t. The calling thread decodes the trace and
+ * routes every address to the owner of its set through a single
+ * producer, single consumer ring. Every set sees its accesses in trace
+ * order, so the counts are identical to a serial run for every policy
+ * (random and brrip keep their state per set). A worker whose thread
+ * cannot be created is simulated by the calling thread, as it routes.
+ */
+#ifndef CACHELAB_SHARD_H
+#define CACHELAB_SHARD_H
+
+#include "cache.h"
+#include "trace.h"
+
+/*
+ * Replay the trace through c, I records are ignored and M counts as a
+ * load and a store. Adds the totals to *hits, *misses and *evictions.
+ * Returns -1 on error.
+ */
+int shard_run(cache_t* c, trace_t* t, int nthreads,
+              long* hits, long* misses, long* evictions);
+
+#endif /* CACHELAB_SHARD_H */
@@ -0,0 +1,75 @@
+/*
+ * spec.c - Row reader shared by the -H, -A and -T descriptions
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "spec.h"
+
+/*
+ * read_file - The whole of fp, NUL terminated; read in chunks so that
+ *     pipes and FIFOs, where ftell fails, work as well as files
+ */
+static char* read_file(FILE* fp)
+{
+    size_t len = 0, cap = 4096, n;
+    char* text = malloc(cap);
+    char* bigger;
+
+    while (text != NULL && (n = fread(text + len, 1, cap - len - 1, fp)) > 0) {
+        len += n;
+        if (len + 1 == cap) {
+            bigger = realloc(text, cap *= 2);
+            if (bigger == NULL)
+                free(text);
+            text = bigger;
+        }
+    }
+    if (text == NULL || ferror(fp)) {
+        free(text);
+        return NULL;
+    }
+    text[len] = '\0';
+    return text;
+}
+
+int spec_rows(const char* spec, int (*row)(void* arg, char* text), void* arg)
+{
+    FILE* fp = fopen(spec, "r");
+    char* text;
+    char* line;
+    char* end;
+    int ret = 0;
+
+    if (fp != NULL) {
+        text = read_file(fp);
+        fclose(fp);
+        if (text == NULL) {
+            fprintf(stderr, "%s: read error\n", spec);
+            return -1;
+        }
+    }
+    else {
+        text = malloc(strlen(spec) + 1);
+        if (text == NULL) {
+            fprintf(stderr, "malloc error.\n");
+            return -1;
+        }
+        strcpy(text, spec);
+    }
+
+    for (line = text; *line && ret == 0; line = end) {
+        char* hash;
+        end = line + strcspn(line, "\n;");
+        if (*end)
+            *end++ = '\0';
+        if ((hash = strchr(line, '#')) != NULL)
+            *hash = '\0';
+        if (line[strspn(line, " \t\r")] == '\0')
+            continue;
+        if (row(arg, line) < 0)
+            ret = -1;
+    }
+    free(text);
+    return ret;
+}
@@ -0,0 +1,18 @@
+/*
+ * spec.h - Row reader shared by the -H, -A and -T descriptions
+ *
+ * A description names a file if it can be opened, otherwise it is the
+ * text itself. Rows end at a newline or ';', '#' starts a comment, and
+ * blank rows are skipped.
+ */
+#ifndef CACHELAB_SPEC_H
+#define CACHELAB_SPEC_H
+
+/*
+ * Call row(arg, text) for every row of spec, in order. Stops at the
+ * first row that returns < 0. Returns 0, or -1 on a read error or a
+ * rejected row.
+ */
+int spec_rows(const char* spec, int (*row)(void* arg, char* text), void* arg);
+
+#endif /* CACHELAB_SPEC_H */
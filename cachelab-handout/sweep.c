@@ -0,0 +1,281 @@
+/*
+ * sweep.c - Simulate many cache geometries in one pass over a trace
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "sweep.h"
+
+#define SWEEP_BATCH 65536       /* records decoded at a time */
+#define SWEEP_MAXVAL 256        /* values per field of a spec */
+
+typedef struct batch {
+    int n;
+    unsigned long addr[SWEEP_BATCH];
+    char op[SWEEP_BATCH];
+} batch_t;
+
+typedef struct worker {
+    pthread_t tid;
+    sweep_t* sw;
+    int first, last;            /* caches first .. last-1 */
+    batch_t* bufs;              /* the two batches */
+    pthread_mutex_t* gate;      /* held until first, last and bar are set */
+    pthread_barrier_t* bar;
+} worker_t;
+
+sweep_t* sweep_new(void)
+{
+    sweep_t* sw = calloc(1, sizeof(sweep_t));
+    if (sw == NULL)
+        fprintf(stderr, "calloc error.\n");
+    return sw;
+}
+
+void sweep_free(sweep_t* sw)
+{
+    if (sw == NULL)
+        return;
+    for (int i = 0; i < sw->n; i++)
+        cache_free(sw->cfg[i].cache);
+    free(sw);
+}
+
+/*
+ * parse_field - Expand "1,2,8-10" into vals, returns the count or -1
+ */
+static int parse_field(const char* field, size_t len, int* vals)
+{
+    int n = 0;
+    const char* p = field;
+    const char* end = field + len;
+
+    while (p < end) {
+        char* q;
+        long lo = strtol(p, &q, 10), hi = lo;
+        if (q == p)
+            return -1;
+        if (q < end && *q == '-') {
+            p = q + 1;
+            hi = strtol(p, &q, 10);
+            if (q == p || hi < lo)
+                return -1;
+        }
+        for (long v = lo; v <= hi; v++) {
+            if (n == SWEEP_MAXVAL)
+                return -1;
+            vals[n++] = v;
+        }
+        if (q < end && *q != ',')
+            return -1;
+        p = q + 1;
+    }
+    return n;
+}
+
+int sweep_add(sweep_t* sw, const char* spec, const char* policy)
+{
+    int vals[3][SWEEP_MAXVAL], cnt[3];
+    const char* p = spec;
+
+    for (int f = 0; f < 3; f++) {
+        size_t len = strcspn(p, ":");
+        if ((f < 2 && p[len] != ':') || (f == 2 && p[len] != '\0') ||
+            (cnt[f] = parse_field(p, len, vals[f])) <= 0) {
+            fprintf(stderr, "bad sweep spec %s, expected s:E:b lists such as 1-8:1,2,4:5\n",
+                    spec);
+            return -1;
+        }
+        p += len + 1;
+    }
+
+    for (int i = 0; i < cnt[0]; i++) {
+        for (int j = 0; j < cnt[1]; j++) {
+            for (int k = 0; k < cnt[2]; k++) {
+                sweep_cfg_t* cfg = &sw->cfg[sw->n];
+                if (sw->n == SWEEP_MAXCFG) {
+                    fprintf(stderr, "at most %d caches per sweep\n", SWEEP_MAXCFG);
+                    return -1;
+                }
+                cfg->s = vals[0][i];
+                cfg->E = vals[1][j];
+                cfg->b = vals[2][k];
+                cfg->cache = cache_new(cfg->s, cfg->E, cfg->b, policy);
+                if (cfg->cache == NULL)
+                    return -1;
+                sw->n++;
+            }
+        }
+    }
+    return 0;
+}
+
+/*
+ * simulate - Run one batch through caches first .. last-1. Cache by
+ *     cache rather than record by record keeps each cache hot.
+ */
+static void simulate(sweep_t* sw, int first, int last, batch_t* bt)
+{
+    for (int i = first; i < last; i++) {
+        sweep_cfg_t* cfg = &sw->cfg[i];
+        cache_t* c = cfg->cache;
+        long hits = 0, misses = 0, evictions = 0;
+
+        for (int r = 0; r < bt->n; r++) {
+            switch (cache_access(c, bt->addr[r])) {
+            case CACHE_HIT:
+                hits++;
+                break;
+            case CACHE_EVICT:
+                evictions++;
+                /* fall through */
+            default:
+                misses++;
+                break;
+            }
+            // M 的第二次访问一定命中
+            if (bt->op[r] == 'M') {
+                cache_access(c, bt->addr[r]);
+                hits++;
+            }
+        }
+        cfg->hits += hits;
+        cfg->misses += misses;
+        cfg->evictions += evictions;
+    }
+}
+
+/*
+ * decode - Fill a batch, I records are dropped
+ */
+static void decode(trace_t* t, batch_t* bt)
+{
+    trace_rec_t rec;
+
+    bt->n = 0;
+    while (bt->n < SWEEP_BATCH && trace_next(t, &rec)) {
+        if (rec.op == 'I')
+            continue;
+        bt->addr[bt->n] = rec.addr;
+        bt->op[bt->n] = rec.op;
+        bt->n++;
+    }
+}
+
+/*
+ * worker_main - Phase k simulates batch k % 2 while the main thread
+ *     decodes the other one; an empty batch ends the run
+ */
+static void* worker_main(void* arg)
+{
+    worker_t* w = arg;
+
+    pthread_mutex_lock(w->gate);
+    pthread_mutex_unlock(w->gate);
+    for (int k = 0; ; k ^= 1) {
+        pthread_barrier_wait(w->bar);
+        if (w->bufs[k].n == 0)
+            break;
+        simulate(w->sw, w->first, w->last, &w->bufs[k]);
+    }
+    return NULL;
+}
+
+/*
+ * run_serial - Decode and simulate every cache in the calling thread
+ */
+static void run_serial(sweep_t* sw, trace_t* t, batch_t* bt)
+{
+    do {
+        decode(t, bt);
+        simulate(sw, 0, sw->n, bt);
+    } while (bt->n > 0);
+}
+
+int sweep_run(sweep_t* sw, trace_t* t, int nthreads)
+{
+    batch_t* bufs = malloc(2 * sizeof(batch_t));
+    worker_t* workers;
+    pthread_mutex_t gate = PTHREAD_MUTEX_INITIALIZER;
+    pthread_barrier_t bar;
+    int started;
+
+    if (bufs == NULL) {
+        fprintf(stderr, "malloc error.\n");
+        return -1;
+    }
+    if (nthreads > sw->n)
+        nthreads = sw->n;
+
+    if (nthreads <= 1) {
+        run_serial(sw, t, &bufs[0]);
+        free(bufs);
+        return 0;
+    }
+
+    workers = calloc(nthreads, sizeof(worker_t));
+    if (workers == NULL) {
+        fprintf(stderr, "calloc error.\n");
+        free(bufs);
+        return -1;
+    }
+
+    // 线程在 gate 上等待, 直到知道实际建成了几个线程
+    pthread_mutex_lock(&gate);
+    for (started = 0; started < nthreads; started++) {
+        workers[started].sw = sw;
+        workers[started].bufs = bufs;
+        workers[started].gate = &gate;
+        workers[started].bar = &bar;
+        if (pthread_create(&workers[started].tid, NULL, worker_main, &workers[started]) != 0) {
+            fprintf(stderr, "sweep: pthread_create failed, running %d of %d threads\n",
+                    started, nthreads);
+            break;
+        }
+    }
+    if (started == 0) {
+        pthread_mutex_unlock(&gate);
+        run_serial(sw, t, &bufs[0]);
+        free(workers);
+        free(bufs);
+        return 0;
+    }
+
+    // 按配置划分给各线程
+    nthreads = started;
+    for (int i = 0; i < nthreads; i++) {
+        workers[i].first = (long)sw->n * i / nthreads;
+        workers[i].last = (long)sw->n * (i + 1) / nthreads;
+    }
+    pthread_barrier_init(&bar, NULL, nthreads + 1);
+    pthread_mutex_unlock(&gate);
+
+    // 线程通过栅栏时上一批已处理完, 可以在它处理本批时解码下一批
+    decode(t, &bufs[0]);
+    for (int k = 0; ; k ^= 1) {
+        pthread_barrier_wait(&bar);
+        if (bufs[k].n == 0)
+            break;
+        decode(t, &bufs[k ^ 1]);
+    }
+
+    for (int i = 0; i < nthreads; i++)
+        pthread_join(workers[i].tid, NULL);
+    pthread_barrier_destroy(&bar);
+    free(workers);
+    free(bufs);
+    return 0;
+}
+
+void sweep_print(sweep_t* sw)
+{
+    printf("s,E,b,size,policy,hits,misses,evictions\n");
+    for (int i = 0; i < sw->n; i++) {
+        sweep_cfg_t* cfg = &sw->cfg[i];
+        printf("%d,%d,%d,%lu,%s,%ld,%ld,%ld\n", cfg->s, cfg->E, cfg->b,
+               (1UL << (cfg->s + cfg->b)) * cfg->E, cfg->cache->policy->name,
+               cfg->hits, cfg->misses, cfg->evictions);
+    }
+}
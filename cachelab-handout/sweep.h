@@ -0,0 +1,45 @@
+/*
+ * sweep.h - Simulate many cache geometries in one pass over a trace
+ *
+ * A sweep spec is "s:E:b", each field a comma separated list of values
+ * or a-b ranges; the sweep covers their cross product. For example
+ * "1-8:1,2,4:5" is 24 caches with 32 byte blocks.
+ */
+#ifndef CACHELAB_SWEEP_H
+#define CACHELAB_SWEEP_H
+
+#include "cache.h"
+#include "trace.h"
+
+#define SWEEP_MAXCFG 4096
+
+typedef struct sweep_cfg {
+    int s, E, b;
+    cache_t* cache;
+    long hits;
+    long misses;
+    long evictions;
+} sweep_cfg_t;
+
+typedef struct sweep {
+    int n;
+    sweep_cfg_t cfg[SWEEP_MAXCFG];
+} sweep_t;
+
+sweep_t* sweep_new(void);
+void sweep_free(sweep_t* sw);
+
+/* Add the cross product described by spec, returns -1 on error */
+int sweep_add(sweep_t* sw, const char* spec, const char* policy);
+
+/*
+ * Replay the trace through every cache. Records are decoded once per
+ * batch; with nthreads > 1 the caches are divided between threads that
+ * work on one batch while the next is decoded.
+ */
+int sweep_run(sweep_t* sw, trace_t* t, int nthreads);
+
+/* CSV with one row per cache */
+void sweep_print(sweep_t* sw);
+
+#endif /* CACHELAB_SWEEP_H */
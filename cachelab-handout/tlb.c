@@ -0,0 +1,112 @@
+/*
+ * tlb.c - Multi-level data TLB on top of cache.c
+ *
+ * Each level is a cache whose blocks are pages. A page walk is counted
+ * with the page table entries an x86-64 four-level walk reads: four for
+ * a 4 KiB page, three for a 2 MiB one.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "spec.h"
+#include "tlb.h"
+
+/*
+ * add_level - Parse one "name entries ways [4k|2m] [policy]" row
+ */
+static int add_level(void* arg, char* row)
+{
+    tlb_t* t = arg;
+    char name[16], page[8] = "4k", policy[32] = "lru";
+    int entries, ways, pagebits, s;
+    tlb_level_t* l;
+
+    if (sscanf(row, "%15s %d %d %7s %31s", name, &entries, &ways, page, policy) < 3) {
+        fprintf(stderr, "bad TLB level \"%s\", expected: name entries ways [4k|2m] [policy]\n", row);
+        return -1;
+    }
+    if (t->nlevels == TLB_MAXLEVELS) {
+        fprintf(stderr, "at most %d TLB levels\n", TLB_MAXLEVELS);
+        return -1;
+    }
+
+    if (strcmp(page, "4k") == 0)
+        pagebits = 12;
+    else if (strcmp(page, "2m") == 0)
+        pagebits = 21;
+    else {
+        fprintf(stderr, "%s: page size must be 4k or 2m\n", name);
+        return -1;
+    }
+    if (t->nlevels > 0 && pagebits != t->pagebits) {
+        fprintf(stderr, "%s: all levels must use the same page size\n", name);
+        return -1;
+    }
+
+    // 组数 entries / ways 必须是 2 的幂
+    if (ways < 1 || entries < ways || entries % ways != 0 ||
+        ((entries / ways) & (entries / ways - 1)) != 0) {
+        fprintf(stderr, "%s: %d entries do not form a power of two sets of %d ways\n",
+                name, entries, ways);
+        return -1;
+    }
+    for (s = 0; (1 << s) < entries / ways; s++)
+        ;
+
+    l = &t->levels[t->nlevels];
+    strcpy(l->name, name);
+    l->entries = entries;
+    l->ways = ways;
+    l->cache = cache_new(s, ways, pagebits, policy);
+    if (l->cache == NULL)
+        return -1;
+    t->pagebits = pagebits;
+    t->walkrefs = pagebits == 12 ? 4 : 3;
+    t->nlevels++;
+    return 0;
+}
+
+/*
+ * tlb_load - spec names a file if it can be opened, otherwise it is
+ *     the description itself with ';' between levels
+ */
+tlb_t* tlb_load(const char* spec)
+{
+    tlb_t* t = calloc(1, sizeof(tlb_t));
+
+    if (t == NULL)
+        return NULL;
+
+    if (spec_rows(spec, add_level, t) < 0) {
+        tlb_free(t);
+        return NULL;
+    }
+
+    if (t->nlevels == 0) {
+        fprintf(stderr, "TLB needs at least one level\n");
+        tlb_free(t);
+        return NULL;
+    }
+    return t;
+}
+
+void tlb_free(tlb_t* t)
+{
+    if (t == NULL)
+        return;
+    for (int i = 0; i < t->nlevels; i++)
+        cache_free(t->levels[i].cache);
+    free(t);
+}
+
+void tlb_print(tlb_t* t)
+{
+    printf("%-8s %8s %6s %5s %12s %12s\n", "tlb", "entries", "ways", "page",
+           "hits", "misses");
+    for (int i = 0; i < t->nlevels; i++) {
+        tlb_level_t* l = &t->levels[i];
+        printf("%-8s %8d %6d %5s %12ld %12ld\n", l->name, l->entries, l->ways,
+               t->pagebits == 12 ? "4k" : "2m", l->hits, l->misses);
+    }
+    printf("page walks:%ld walk refs:%ld\n", t->walks, t->walks * t->walkrefs);
+}
@@ -0,0 +1,58 @@
+/*
+ * tlb.h - Multi-level data TLB on top of cache.c
+ *
+ * A TLB is described one level per line (or per ';' separated field
+ * when given inline):
+ *
+ *   name  entries  ways  [4k|2m]  [policy]
+ *
+ * entries / ways must be a power of two; ways equal to entries makes
+ * the level fully associative. Levels are searched in order, a miss in
+ * every level is a page walk, and the translation is then installed in
+ * each level that missed. All levels must use the same page size.
+ */
+#ifndef CACHELAB_TLB_H
+#define CACHELAB_TLB_H
+
+#include "cache.h"
+
+#define TLB_MAXLEVELS 4
+
+typedef struct tlb_level {
+    char name[16];
+    int entries;
+    int ways;
+    cache_t* cache;         /* one line per translation */
+    long hits;
+    long misses;
+} tlb_level_t;
+
+typedef struct tlb {
+    int nlevels;
+    int pagebits;           /* 12 or 21 */
+    int walkrefs;           /* page table entries read per walk */
+    tlb_level_t levels[TLB_MAXLEVELS];
+    long walks;
+} tlb_t;
+
+/* Build a TLB from a file name or an inline spec, NULL on error */
+tlb_t* tlb_load(const char* spec);
+void tlb_free(tlb_t* t);
+
+/* Translate addr, returns the level that hit or nlevels for a walk */
+static inline int tlb_access(tlb_t* t, unsigned long addr)
+{
+    for (int i = 0; i < t->nlevels; i++) {
+        if (cache_access(t->levels[i].cache, addr) == CACHE_HIT) {
+            t->levels[i].hits++;
+            return i;
+        }
+        t->levels[i].misses++;
+    }
+    t->walks++;
+    return t->nlevels;
+}
+
+void tlb_print(tlb_t* t);
+
+#endif /* CACHELAB_TLB_H */
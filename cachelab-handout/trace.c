@@ -0,0 +1,278 @@
+/*
+ * trace.c - Reader for valgrind lackey memory traces
+ *
+ * Lines look like "I 0400d7d4,8" or " L 7ff0005b8,8". The whole file
+ * is mmap'ed and decoded in place with a table driven hex parser, so
+ * there is no per-line copy, strlen or sscanf. Binary traces produced
+ * by trace2bin are recognized by their magic and decoded word by word.
+ *
+ * Anything that cannot be mapped is streamed through one buffer. The
+ * text decoder is unchanged: refill() only ever exposes whole lines to
+ * it, and moves an incomplete last line to the front for the next read.
+ */
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "trace.h"
+
+const char trace_ops[4] = {'I', 'L', 'S', 'M'};
+
+/* Value of each hex digit, 0xff for anything else */
+static unsigned char hexval[256];
+
+static void init_hexval(void)
+{
+    static int done = 0;
+    int i;
+
+    if (done)
+        return;
+    memset(hexval, 0xff, sizeof(hexval));
+    for (i = 0; i < 10; i++)
+        hexval['0' + i] = i;
+    for (i = 0; i < 6; i++) {
+        hexval['a' + i] = 10 + i;
+        hexval['A' + i] = 10 + i;
+    }
+    done = 1;
+}
+
+/*
+ * refill - Keep the undecoded bytes and read until there are at least
+ *     need of them and, for text, a complete line. Returns 0 when there
+ *     is nothing left to decode.
+ */
+static int refill(trace_t* t, size_t need)
+{
+    char* buf = (char*)t->base;
+    char* fill = buf + (t->fill - t->pos);
+    char* scan = buf;
+    int line = t->binary;
+    const char* q;
+
+    memmove(buf, t->pos, fill - buf);
+    t->pos = buf;
+
+    // 读到足够的字节且有一整行, 或者缓冲区满, 或者结束
+    while (!t->eof && fill < buf + TRACE_BUFSIZE) {
+        ssize_t n;
+        if (!line)
+            line = memchr(scan, '\n', fill - scan) != NULL;
+        if (line && (size_t)(fill - buf) >= need)
+            break;
+        scan = fill;
+        n = read(t->fd, fill, buf + TRACE_BUFSIZE - fill);
+        if (n < 0) {
+            perror("read");
+            n = 0;
+        }
+        if (n == 0)
+            t->eof = 1;
+        fill += n;
+    }
+    t->fill = fill;
+
+    // 只交出完整的行; 二进制, 结束时或者超长的行则全部交出
+    for (q = fill; q > buf && q[-1] != '\n'; q--)
+        ;
+    t->end = t->binary || t->eof || q == buf ? fill : q;
+    return t->end > t->pos;
+}
+
+/*
+ * trace_open - Map the trace file read-only into memory, or set up a
+ *     read buffer if it cannot be mapped
+ */
+trace_t* trace_open(const char* filename)
+{
+    struct stat st;
+    trace_t* t;
+
+    init_hexval();
+
+    t = calloc(1, sizeof(trace_t));
+    if (t == NULL) {
+        fprintf(stderr, "calloc error.\n");
+        return NULL;
+    }
+
+    t->fd = strcmp(filename, "-") == 0 ? dup(STDIN_FILENO) : open(filename, O_RDONLY);
+    if (t->fd < 0 || fstat(t->fd, &st) < 0) {
+        perror(filename);
+        trace_close(t);
+        return NULL;
+    }
+
+    if (S_ISREG(st.st_mode) && st.st_size > 0) {
+        void* p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, t->fd, 0);
+        if (p != MAP_FAILED) {
+            madvise(p, st.st_size, MADV_SEQUENTIAL);
+            t->base = p;
+            t->size = st.st_size;
+        }
+    }
+    if (t->base == NULL && !(S_ISREG(st.st_mode) && st.st_size == 0)) {
+        t->stream = 1;
+        t->base = malloc(TRACE_BUFSIZE);
+        if (t->base == NULL) {
+            fprintf(stderr, "malloc error.\n");
+            trace_close(t);
+            return NULL;
+        }
+    }
+    t->pos = t->base;
+    t->end = t->fill = t->base + t->size;
+
+    // 流先读入一块, 以便识别文件头
+    if (t->stream)
+        refill(t, sizeof(trace_bin_hdr_t));
+
+    if (t->fill - t->base >= (long)sizeof(trace_bin_hdr_t) &&
+        memcmp(t->base, TRACE_BIN_MAGIC, 8) == 0) {
+        trace_bin_hdr_t hdr;
+        memcpy(&hdr, t->base, sizeof(hdr));
+        if (hdr.version != TRACE_BIN_VERSION) {
+            fprintf(stderr, "%s: unsupported binary trace version %u\n",
+                    filename, hdr.version);
+            trace_close(t);
+            return NULL;
+        }
+        t->binary = 1;
+        t->pos += sizeof(hdr);
+        t->end = t->fill;
+    }
+    return t;
+}
+
+/*
+ * trace_next_bin - Decode one record of a binary trace
+ */
+static int trace_next_bin(trace_t* t, trace_rec_t* rec)
+{
+    uint32_t w;
+
+    if (t->stream && t->end - t->pos < 12)
+        refill(t, 12);
+    if (t->end - t->pos < 4)
+        return 0;
+    memcpy(&w, t->pos, 4);
+    t->pos += 4;
+
+    if (w & TRACE_BIN_FAR) {
+        uint32_t half[2];
+        if (t->end - t->pos < 8)
+            return 0;
+        memcpy(half, t->pos, 8);
+        t->pos += 8;
+        t->prev = ((unsigned long)half[1] << 32) | half[0];
+    }
+    else {
+        // 高 24 位为有符号差值
+        t->prev += (long)((int32_t)w >> 8);
+    }
+
+    rec->op = trace_ops[w & 3];
+    rec->size = ((w >> 2) & (TRACE_BIN_MAXSIZE - 1)) + 1;
+    rec->addr = t->prev;
+    rec->line = NULL;
+    rec->len = 0;
+    return 1;
+}
+
+/*
+ * next_line - Decode one text record starting at t->pos. Lines that are not
+ *     memory accesses (e.g. valgrind's "==pid==" banner) are skipped.
+ */
+static int next_line(trace_t* t, trace_rec_t* rec)
+{
+    const char* p = t->pos;
+    const char* end = t->end;
+
+    while (p < end) {
+        const char* line;
+        const char* q;
+        unsigned long addr = 0;
+        unsigned int size = 0;
+        unsigned char d;
+        char op;
+
+        // 跳过行头空格
+        while (p < end && *p == ' ')
+            p++;
+        line = p;
+        if (p + 2 >= end)
+            break;
+
+        op = *p;
+        if ((op != 'L' && op != 'S' && op != 'M' && op != 'I') || p[1] != ' ')
+            goto skip;
+        p += 2;
+        while (p < end && *p == ' ')
+            p++;
+
+        // 地址
+        q = p;
+        while (p < end && (d = hexval[(unsigned char)*p]) != 0xff) {
+            addr = (addr << 4) | d;
+            p++;
+        }
+        if (p == q || p >= end || *p != ',')
+            goto skip;
+        p++;
+
+        // 访问大小
+        while (p < end && (unsigned char)(*p - '0') < 10) {
+            size = size * 10 + (*p - '0');
+            p++;
+        }
+
+        rec->op = op;
+        rec->addr = addr;
+        rec->size = size;
+        rec->line = line;
+
+        // 行尾可能还有空格
+        q = memchr(p, '\n', end - p);
+        if (q == NULL)
+            q = end;
+        rec->len = p - line;
+        t->pos = q < end ? q + 1 : end;
+        return 1;
+
+    skip:
+        q = memchr(p, '\n', end - p);
+        p = q ? q + 1 : end;
+    }
+
+    t->pos = end;
+    return 0;
+}
+
+int trace_next(trace_t* t, trace_rec_t* rec)
+{
+    if (t->binary)
+        return trace_next_bin(t, rec);
+    while (!next_line(t, rec)) {
+        if (!t->stream || !refill(t, 0))
+            return 0;
+    }
+    return 1;
+}
+
+void trace_close(trace_t* t)
+{
+    if (t == NULL)
+        return;
+    if (t->size > 0)
+        munmap((void*)t->base, t->size);
+    if (t->stream)
+        free((void*)t->base);
+    if (t->fd >= 0)
+        close(t->fd);
+    free(t);
+}
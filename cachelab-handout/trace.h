@@ -0,0 +1,83 @@
+/*
+ * trace.h - Reader for valgrind lackey memory traces
+ *
+ * The trace file is mapped into memory and scanned in place: each
+ * call to trace_next() decodes exactly one record without copying
+ * the line anywhere. Pipes, FIFOs and "-" (stdin) cannot be mapped;
+ * they are read through a fixed TRACE_BUFSIZE buffer instead, so a
+ * trace of any length streams through in constant memory.
+ *
+ * Besides the textual lackey format, trace_open() also accepts the
+ * packed binary format written by trace2bin:
+ *
+ *   header   8 byte magic "CSIMBIN1", uint32 version, uint32 flags,
+ *            uint64 number of records
+ *   record   one little-endian uint32 word
+ *              bits  0-1   op (0 I, 1 L, 2 S, 3 M)
+ *              bits  2-6   size in bytes minus one (1..32)
+ *              bit   7     far: the address does not fit in the delta
+ *              bits  8-31  signed address delta from the previous record
+ *            a far record is followed by two more words, the low and
+ *            high halves of the absolute address.
+ */
+#ifndef CACHELAB_TRACE_H
+#define CACHELAB_TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define TRACE_BIN_MAGIC     "CSIMBIN1"
+#define TRACE_BIN_VERSION   2
+#define TRACE_BIN_MAXSIZE   32
+#define TRACE_BIN_FAR       0x80
+#define TRACE_BIN_DELTA_MIN (-(1L << 23))
+#define TRACE_BIN_DELTA_MAX ((1L << 23) - 1)
+
+#define TRACE_BUFSIZE       (1 << 20)   /* read buffer for streams */
+
+typedef struct trace_bin_hdr {
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;
+    uint64_t nrecords;
+} trace_bin_hdr_t;
+
+/* op characters indexed by the binary op code */
+extern const char trace_ops[4];
+
+typedef struct trace_rec {
+    char op;                /* 'I', 'L', 'S' or 'M' */
+    unsigned int size;      /* access size in bytes */
+    unsigned long addr;     /* access address */
+    const char* line;       /* record text, leading blank and newline stripped,
+                               NULL for binary traces; valid until the next
+                               trace_next() */
+    int len;                /* length of line */
+} trace_rec_t;
+
+typedef struct trace {
+    int fd;
+    const char* base;       /* start of the mapping or buffer */
+    size_t size;            /* length of the mapping, 0 when streaming */
+    const char* pos;        /* next byte to decode */
+    const char* end;        /* end of what may be decoded; a stream stops
+                               after the last complete line */
+    const char* fill;       /* end of the data read so far, streams only */
+    int stream;             /* read through a buffer */
+    int eof;                /* the stream has no more data */
+    int binary;             /* packed binary format */
+    unsigned long prev;     /* previous address, binary format only */
+} trace_t;
+
+/*
+ * Open a trace file, "-" is stdin. Returns NULL and prints a message
+ * on failure.
+ */
+trace_t* trace_open(const char* filename);
+
+/* Decode the next record, returns 0 at end of trace */
+int trace_next(trace_t* t, trace_rec_t* rec);
+
+void trace_close(trace_t* t);
+
+#endif /* CACHELAB_TRACE_H */
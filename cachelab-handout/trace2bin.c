@@ -0,0 +1,134 @@
+/*
+ * trace2bin.c - Convert a valgrind lackey trace to the packed binary
+ *     trace format read by csim (see trace.h), or back with -d.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include "trace.h"
+
+static int put(const void* p, size_t n, FILE* out)
+{
+    return fwrite(p, n, 1, out) == 1 ? 0 : -1;
+}
+
+/*
+ * encode - Write the records of a text trace as binary
+ */
+static int encode(trace_t* in, FILE* out)
+{
+    trace_bin_hdr_t hdr;
+    trace_rec_t rec;
+    unsigned long prev = 0;
+    uint32_t w;
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, TRACE_BIN_MAGIC, 8);
+    hdr.version = TRACE_BIN_VERSION;
+    if (put(&hdr, sizeof(hdr), out) < 0)
+        return -1;
+
+    while (trace_next(in, &rec)) {
+        long delta = (long)(rec.addr - prev);
+
+        if (rec.size < 1 || rec.size > TRACE_BIN_MAXSIZE) {
+            fprintf(stderr, "record %lu: size %u does not fit, 1 to %d\n",
+                    (unsigned long)hdr.nrecords, rec.size, TRACE_BIN_MAXSIZE);
+            return -1;
+        }
+
+        w = (uint32_t)((const char*)memchr(trace_ops, rec.op, 4) - trace_ops);
+        w |= (rec.size - 1) << 2;
+        if (delta < TRACE_BIN_DELTA_MIN || delta > TRACE_BIN_DELTA_MAX) {
+            uint32_t half[2] = {(uint32_t)rec.addr, (uint32_t)(rec.addr >> 32)};
+            w |= TRACE_BIN_FAR;
+            if (put(&w, 4, out) < 0 || put(half, 8, out) < 0)
+                return -1;
+        }
+        else {
+            w |= (uint32_t)delta << 8;
+            if (put(&w, 4, out) < 0)
+                return -1;
+        }
+        prev = rec.addr;
+        hdr.nrecords++;
+    }
+
+    // 回填记录数
+    if (fseek(out, 0, SEEK_SET) != 0 || put(&hdr, sizeof(hdr), out) < 0)
+        return -1;
+    return 0;
+}
+
+/*
+ * decode - Write the records of a binary trace in lackey format
+ */
+static int decode(trace_t* in, FILE* out)
+{
+    trace_rec_t rec;
+
+    while (trace_next(in, &rec)) {
+        fprintf(out, "%s%c %08lx,%u\n", rec.op == 'I' ? "" : " ",
+                rec.op, rec.addr, rec.size);
+    }
+    return ferror(out) ? -1 : 0;
+}
+
+static void usage(char* argv[])
+{
+    printf("Usage: %s [-h] [-d] <infile> <outfile>\n", argv[0]);
+    printf("Options:\n");
+    printf("  -h          Print this help message.\n");
+    printf("  -d          Decode a binary trace back to text.\n");
+    printf("Example: %s traces/long.trace long.bin\n", argv[0]);
+}
+
+int main(int argc, char* argv[])
+{
+    int decodeflag = 0;
+    int c, rc;
+    trace_t* in;
+    FILE* out;
+
+    while ((c = getopt(argc, argv, "dh")) != -1) {
+        switch (c) {
+        case 'd':
+            decodeflag = 1;
+            break;
+        case 'h':
+            usage(argv);
+            exit(0);
+        default:
+            usage(argv);
+            exit(1);
+        }
+    }
+    if (argc - optind != 2) {
+        usage(argv);
+        exit(1);
+    }
+
+    in = trace_open(argv[optind]);
+    if (in == NULL)
+        exit(1);
+    if (in->binary != decodeflag) {
+        fprintf(stderr, "%s: input is %s a binary trace\n",
+                argv[optind], in->binary ? "already" : "not");
+        exit(1);
+    }
+
+    out = fopen(argv[optind + 1], "wb");
+    if (out == NULL) {
+        perror(argv[optind + 1]);
+        exit(1);
+    }
+
+    rc = decodeflag ? decode(in, out) : encode(in, out);
+    trace_close(in);
+    if (fclose(out) != 0 || rc != 0) {
+        fprintf(stderr, "%s: conversion failed\n", argv[optind + 1]);
+        exit(1);
+    }
+    return 0;
+}
@@ -5,6 +5,9 @@
  * The beginning and end of each registered transpose function's trace
  * is indicated by reading from "marker" addresses. These two marker
  * addresses are recorded in file for later use.
+ *
+ * With -I only the in-place functions run, each on a fresh A that it
+ * is also given as B; the transpose it should produce is kept in B.
  */
 
 #include <stdlib.h>
@@ -22,6 +25,10 @@ extern int func_counter;
 /* External function from trans.c */
 extern void registerFunctions();
 
+/* trans_par's settings, in trans.c */
+extern int trans_threads;
+extern long trans_par_min;
+
 /* Markers used to bound trace regions of interest */
 volatile char MARKER_START, MARKER_END;
 
@@ -29,6 +36,7 @@ static int A[256][256];
 static int B[256][256];
 static int M;
 static int N;
+static int inplace = 0;
 
 
 int validate(int fn,int M, int N, int A[N][M], int B[M][N]) {
@@ -46,12 +54,33 @@ int validate(int fn,int M, int N, int A[N][M], int B[M][N]) {
     return 1;
 }
 
+/*
+ * run - Trace function fn, returns 0 if its result is right
+ */
+static int run(int fn)
+{
+    if (!inplace) {
+        MARKER_START = 33;
+        (*func_list[fn].func_ptr)(M, N, A, B);
+        MARKER_END = 34;
+        return validate(fn, M, N, A, B);
+    }
+
+    /* B keeps the original for the check, A ends up transposed */
+    initMatrix(M, N, A, B);
+    memcpy(B, A, sizeof(int) * M * N);
+    MARKER_START = 33;
+    (*func_list[fn].func_ptr)(M, N, A, (int (*)[N])A);
+    MARKER_END = 34;
+    return validate(fn, M, N, (int (*)[M])B, (int (*)[N])A);
+}
+
 int main(int argc, char* argv[]){
     int i;
 
     char c;
     int selectedFunc=-1;
-    while( (c=getopt(argc,argv,"M:N:F:")) != -1){
+    while( (c=getopt(argc,argv,"M:N:F:I")) != -1){
         switch(c){
         case 'M':
             M = atoi(optarg);
@@ -62,6 +91,9 @@ int main(int argc, char* argv[]){
         case 'F':
             selectedFunc = atoi(optarg);
             break;
+        case 'I':
+            inplace = 1;
+            break;
         case '?':
         default:
             printf("./tracegen failed to parse its options.\n");
@@ -73,6 +105,10 @@ int main(int argc, char* argv[]){
     /*  Register transpose functions */
     registerFunctions();
 
+    /* Trace trans_par's tiles on these small matrices, in one thread */
+    trans_par_min = 0;
+    trans_threads = 1;
+
     /* Fill A with data */
     initMatrix(M,N, A, B); 
 
@@ -84,20 +120,30 @@ int main(int argc, char* argv[]){
             (unsigned long long int) &MARKER_END );
     fclose(marker_fp);
 
+    /* Record the matrices as regions for csim -A */
+    FILE* region_fp = fopen(".regions","w");
+    assert(region_fp);
+    fprintf(region_fp, "A %#llx %#llx\nB %#llx %#llx\n",
+            (unsigned long long int) A,
+            (unsigned long long int) A + sizeof(A),
+            (unsigned long long int) B,
+            (unsigned long long int) B + sizeof(B));
+    fclose(region_fp);
+
     if (-1==selectedFunc) {
         /* Invoke registered transpose functions */
         for (i=0; i < func_counter; i++) {
-            MARKER_START = 33;
-            (*func_list[i].func_ptr)(M, N, A, B);
-            MARKER_END = 34;
-            if (!validate(i,M,N,A,B))
+            if (inplace && !func_list[i].inplace)
+                continue;
+            if (!run(i))
                 return i+1;
         }
     } else {
-        MARKER_START = 33;
-        (*func_list[selectedFunc].func_ptr)(M, N, A, B);
-        MARKER_END = 34;
-        if (!validate(selectedFunc,M,N,A,B))
+        if (inplace && !func_list[selectedFunc].inplace) {
+            printf("Function %d does not transpose in place.\n", selectedFunc);
+            return selectedFunc+1;
+        }
+        if (!run(selectedFunc))
             return selectedFunc+1;
 
     }
@@ -0,0 +1,62 @@
+/*
+ * transgen.c - The element sizes of transgen.h and their kernels
+ *
+ * With SSE2 a kdim x kdim square is kdim 16 byte rows, transposed by
+ * log2(kdim) rounds that interleave row r with row r + kdim/2: after
+ * the last round row r holds column r. That gives 16x16 for bytes, 8x8
+ * for 16 bits, 4x4 for 32 bits and 2x2 for 64 bits; a 16 byte record
+ * is one vector and only needs to be moved.
+ */
+#include "transgen.h"
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#if defined(__SSE2__)
+
+#define TRANSGEN_SSE_KERNEL(name, type, kdim, rounds, lo, hi)                 \
+static inline void name(type* a, long lda, type* b, long ldb)                 \
+{                                                                             \
+    __m128i r[kdim], t[kdim];                                                 \
+    int k, n;                                                                 \
+                                                                              \
+    for (k = 0; k < (kdim); k++)                                              \
+        r[k] = _mm_loadu_si128((__m128i*)(a + k * lda));                      \
+    for (n = 0; n < (rounds); n++) {                                          \
+        for (k = 0; k < (kdim) / 2; k++) {                                    \
+            t[2 * k] = lo(r[k], r[k + (kdim) / 2]);                           \
+            t[2 * k + 1] = hi(r[k], r[k + (kdim) / 2]);                       \
+        }                                                                     \
+        for (k = 0; k < (kdim); k++)                                          \
+            r[k] = t[k];                                                      \
+    }                                                                         \
+    for (k = 0; k < (kdim); k++)                                              \
+        _mm_storeu_si128((__m128i*)(b + k * ldb), r[k]);                      \
+}
+
+TRANSGEN_SSE_KERNEL(kernel_u8, uint8_t, 16, 4, _mm_unpacklo_epi8, _mm_unpackhi_epi8)
+TRANSGEN_SSE_KERNEL(kernel_u16, uint16_t, 8, 3, _mm_unpacklo_epi16, _mm_unpackhi_epi16)
+TRANSGEN_SSE_KERNEL(kernel_u32, uint32_t, 4, 2, _mm_unpacklo_epi32, _mm_unpackhi_epi32)
+TRANSGEN_SSE_KERNEL(kernel_u64, uint64_t, 2, 1, _mm_unpacklo_epi64, _mm_unpackhi_epi64)
+
+static inline void kernel_rec16(transgen_rec16_t* a, long lda, transgen_rec16_t* b, long ldb)
+{
+    _mm_storeu_si128((__m128i*)b, _mm_loadu_si128((__m128i*)a));
+}
+
+#else
+
+TRANSGEN_SCALAR_KERNEL(kernel_u8, uint8_t, 16)
+TRANSGEN_SCALAR_KERNEL(kernel_u16, uint16_t, 8)
+TRANSGEN_SCALAR_KERNEL(kernel_u32, uint32_t, 4)
+TRANSGEN_SCALAR_KERNEL(kernel_u64, uint64_t, 2)
+TRANSGEN_SCALAR_KERNEL(kernel_rec16, transgen_rec16_t, 1)
+
+#endif
+
+/* A line's worth of elements per tile row, at least one kernel square */
+TRANSGEN_DEFINE(transpose_u8, uint8_t, TRANSGEN_LINE, 16, kernel_u8)
+TRANSGEN_DEFINE(transpose_u16, uint16_t, TRANSGEN_LINE / 2, 8, kernel_u16)
+TRANSGEN_DEFINE(transpose_u32, uint32_t, TRANSGEN_LINE / 4, 4, kernel_u32)
+TRANSGEN_DEFINE(transpose_u64, uint64_t, TRANSGEN_LINE / 8, 2, kernel_u64)
+TRANSGEN_DEFINE(transpose_rec16, transgen_rec16_t, TRANSGEN_LINE / 16, 1, kernel_rec16)
@@ -0,0 +1,91 @@
+/*
+ * transgen.h - Blocked transpose for any element size
+ *
+ * TRANSGEN_DEFINE(name, type, tile, kdim, kernel) expands to
+ *
+ *   void name(int M, int N, type A[N][M], type B[M][N]);
+ *   int name_is_transpose(int M, int N, type A[N][M], type B[M][N]);
+ *
+ * The transpose walks B in tile x tile blocks and hands every full
+ * kdim x kdim square of a block to
+ *
+ *   void kernel(type* a, long lda, type* b, long ldb);
+ *
+ * which transposes kdim rows of a (lda elements apart) into kdim rows of
+ * b; whatever is left at the edges is copied an element at a time. The
+ * best tile depends on how many elements a cache line holds, so each
+ * element size below has its own, a line's worth of elements per row.
+ * TRANSGEN_SCALAR_KERNEL makes a kernel for types without a vector one,
+ * e.g. records of odd sizes. is_transpose compares elements bytewise,
+ * so it works for structs too.
+ */
+#ifndef CACHELAB_TRANSGEN_H
+#define CACHELAB_TRANSGEN_H
+
+#include <stdint.h>
+#include <string.h>
+
+/* Cache line the tiles are sized for */
+#define TRANSGEN_LINE   64
+
+#define TRANSGEN_DEFINE(name, type, tile, kdim, kernel)                       \
+void name(int M, int N, type A[N][M], type B[M][N])                           \
+{                                                                             \
+    int i0, j0, i1, j1, i, j, ik, jk;                                         \
+                                                                              \
+    for (j0 = 0; j0 < M; j0 += (tile)) {                                      \
+        j1 = j0 + (tile) < M ? j0 + (tile) : M;                               \
+        for (i0 = 0; i0 < N; i0 += (tile)) {                                  \
+            i1 = i0 + (tile) < N ? i0 + (tile) : N;                           \
+            /* Full kdim squares through the kernel, then the edges */        \
+            ik = i0 + (i1 - i0) / (kdim) * (kdim);                            \
+            jk = j0 + (j1 - j0) / (kdim) * (kdim);                            \
+            for (i = i0; i < ik; i += (kdim)) {                               \
+                for (j = j0; j < jk; j += (kdim))                             \
+                    kernel(&A[i][j], M, &B[j][i], N);                         \
+            }                                                                 \
+            for (i = i0; i < i1; i++) {                                       \
+                for (j = i < ik ? jk : j0; j < j1; j++)                       \
+                    B[j][i] = A[i][j];                                        \
+            }                                                                 \
+        }                                                                     \
+    }                                                                         \
+}                                                                             \
+                                                                              \
+int name##_is_transpose(int M, int N, type A[N][M], type B[M][N])             \
+{                                                                             \
+    for (int i = 0; i < N; i++) {                                            \
+        for (int j = 0; j < M; j++) {                                         \
+            if (memcmp(&A[i][j], &B[j][i], sizeof(type)) != 0)                \
+                return 0;                                                     \
+        }                                                                     \
+    }                                                                         \
+    return 1;                                                                 \
+}
+
+#define TRANSGEN_SCALAR_KERNEL(name, type, kdim)                              \
+static inline void name(type* a, long lda, type* b, long ldb)                 \
+{                                                                             \
+    for (long r = 0; r < (kdim); r++) {                                       \
+        for (long c = 0; c < (kdim); c++)                                     \
+            b[c * ldb + r] = a[r * lda + c];                                  \
+    }                                                                         \
+}
+
+/* A 16 byte record */
+typedef struct transgen_rec16 {
+    uint64_t lo, hi;
+} transgen_rec16_t;
+
+#define TRANSGEN_DECLARE(name, type)                                          \
+    void name(int M, int N, type A[N][M], type B[M][N]);                      \
+    int name##_is_transpose(int M, int N, type A[N][M], type B[M][N])
+
+/* The instances in transgen.c */
+TRANSGEN_DECLARE(transpose_u8, uint8_t);
+TRANSGEN_DECLARE(transpose_u16, uint16_t);
+TRANSGEN_DECLARE(transpose_u32, uint32_t);
+TRANSGEN_DECLARE(transpose_u64, uint64_t);
+TRANSGEN_DECLARE(transpose_rec16, transgen_rec16_t);
+
+#endif /* CACHELAB_TRANSGEN_H */
@@ -0,0 +1,428 @@
+/*
+ * tune-trans.c - Search blocked transpose variants for the fewest misses
+ *
+ * A variant is a block height (rows of A) and width (columns of A), the
+ * order of the block loops, the order inside a block, and a buffering
+ * depth: how many elements are loaded into locals before they are
+ * stored, the a1..a8 trick of the handout solutions. Instead of
+ * compiling every variant, its load and store stream is generated here
+ * and replayed through cache.c. By default A and B are page aligned
+ * and back to back, which puts them in the same sets as test-trans does
+ * only while s + b <= 12; for larger caches, -r takes the addresses
+ * from the .regions file tracegen writes, so the counts are for the
+ * layout the valgrind trace has.
+ *
+ * The search skips variants that are the same stream as one already
+ * listed (a depth beyond the block, an inner order that a one-wide
+ * block makes moot, an outer order over a single block row or column,
+ * a block width that column-major blocks in block-row order never see,
+ * a block height that row-major blocks in block-column order never see),
+ * and stops simulating a variant as soon as its misses exceed the k-th
+ * best complete result. The best variant is printed as a C function
+ * that can be pasted into trans.c.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include "cache.h"
+
+/* Same bounds as test-trans; A, then B, page aligned unless -r */
+#define MAXN        256
+static unsigned long abase = 0x100000UL;
+static unsigned long bbase = 0x100000UL + MAXN * MAXN * sizeof(int);
+
+/* Locals besides the loop counters, the handout allows 12 in all */
+#define MAXDEPTH    8
+
+enum {
+    BLOCKS_ROWS = 0,        /* block loops: row of blocks after row */
+    BLOCKS_COLS             /* column of blocks after column */
+};
+
+enum {
+    INNER_ROWS = 0,         /* inside a block: along rows of A, buffer along j */
+    INNER_COLS              /* along columns of A, buffer along i */
+};
+
+typedef struct variant {
+    int bh, bw;
+    int outer, inner;
+    int depth;
+    long misses;
+    long hits;
+} variant_t;
+
+static const char* outer_names[] = {"block-rows", "block-cols"};
+static const char* inner_names[] = {"rows", "cols"};
+
+static int M, N;
+static cache_t* cache;
+static long hits, misses;
+
+static inline void touch(unsigned long addr)
+{
+    if (cache_access(cache, addr) == CACHE_HIT)
+        hits++;
+    else
+        misses++;
+}
+
+#define LOAD_A(i, j)    touch(abase + ((unsigned long)(i) * M + (j)) * sizeof(int))
+#define STORE_B(j, i)   touch(bbase + ((unsigned long)(j) * N + (i)) * sizeof(int))
+
+/*
+ * run_block - The accesses of one block, in the order the emitted code
+ *     makes them at -O0
+ */
+static void run_block(const variant_t* v, int ii, int jj)
+{
+    int iend = ii + v->bh < N ? ii + v->bh : N;
+    int jend = jj + v->bw < M ? jj + v->bw : M;
+    int i, j, k;
+
+    if (v->inner == INNER_ROWS) {
+        for (i = ii; i < iend; i++) {
+            for (j = jj; j + v->depth <= jend; j += v->depth) {
+                for (k = 0; k < v->depth; k++)
+                    LOAD_A(i, j + k);
+                for (k = 0; k < v->depth; k++)
+                    STORE_B(j + k, i);
+            }
+            for (; j < jend; j++) {
+                LOAD_A(i, j);
+                STORE_B(j, i);
+            }
+        }
+    }
+    else {
+        for (j = jj; j < jend; j++) {
+            for (i = ii; i + v->depth <= iend; i += v->depth) {
+                for (k = 0; k < v->depth; k++)
+                    LOAD_A(i + k, j);
+                for (k = 0; k < v->depth; k++)
+                    STORE_B(j, i + k);
+            }
+            for (; i < iend; i++) {
+                LOAD_A(i, j);
+                STORE_B(j, i);
+            }
+        }
+    }
+}
+
+/*
+ * simulate - Count the misses of v on a fresh cache. Gives up and
+ *     returns 0 once they exceed bound.
+ */
+static int simulate(variant_t* v, int s, int E, int b, const char* policy, long bound)
+{
+    int pruned = 0;
+
+    cache = cache_new(s, E, b, policy);
+    if (cache == NULL)
+        exit(1);
+    hits = misses = 0;
+
+    if (v->outer == BLOCKS_ROWS) {
+        for (int ii = 0; ii < N && !pruned; ii += v->bh) {
+            for (int jj = 0; jj < M && !pruned; jj += v->bw) {
+                run_block(v, ii, jj);
+                pruned = misses > bound;
+            }
+        }
+    }
+    else {
+        for (int jj = 0; jj < M && !pruned; jj += v->bw) {
+            for (int ii = 0; ii < N && !pruned; ii += v->bh) {
+                run_block(v, ii, jj);
+                pruned = misses > bound;
+            }
+        }
+    }
+    cache_free(cache);
+    v->hits = hits;
+    v->misses = misses;
+    return !pruned;
+}
+
+/*
+ * sizes - Candidate block extents for a dimension of n: powers of two
+ *     and their 1.5 multiples below n, and n itself
+ */
+static int sizes(int n, int* out)
+{
+    int k = 0;
+
+    for (int p = 1; p < n; p *= 2) {
+        out[k++] = p;
+        if (p >= 2 && p + p / 2 < n)
+            out[k++] = p + p / 2;
+    }
+    out[k++] = n;
+    return k;
+}
+
+/*
+ * redundant - Whether v makes the same accesses as a variant that the
+ *     search visits anyway
+ */
+static int redundant(const variant_t* v)
+{
+    int along = v->inner == INNER_ROWS ? v->bw : v->bh;
+
+    // 深度超过块的边长时只剩逐个元素的尾部循环, 与深度 1 相同
+    if (v->depth > 1 && v->depth > along)
+        return 1;
+    // 一列宽的块按行按列走都一样, 一行高的块同理
+    if (v->inner == INNER_COLS && v->bh == 1)
+        return 1;
+    if (v->inner == INNER_ROWS && v->bw == 1 && v->bh > 1)
+        return 1;
+    // 只有一行或一列块时, 外层顺序无关
+    if (v->outer == BLOCKS_COLS && (v->bw >= M || v->bh >= N))
+        return 1;
+    // 按块行走、块内按列走时相邻块首尾相接, 块宽无关, 只留 bw == M;
+    // 按块列走、块内按行走时块高无关, 只留 bh == N (上一条已跳过)
+    if (v->outer == BLOCKS_ROWS && v->inner == INNER_COLS && v->bw != M)
+        return 1;
+    if (v->outer == BLOCKS_COLS && v->inner == INNER_ROWS && v->bh != N)
+        return 1;
+    return 0;
+}
+
+/*
+ * emit - Print v as a transpose function for trans.c
+ */
+static void emit(FILE* fp, const variant_t* v, int s, int E, int b)
+{
+    const char* ii = v->outer == BLOCKS_ROWS ? "ii" : "jj";
+    const char* jj = v->outer == BLOCKS_ROWS ? "jj" : "ii";
+    const char* x = v->inner == INNER_ROWS ? "i" : "j";     /* outer index in a block */
+    const char* y = v->inner == INNER_ROWS ? "j" : "i";     /* buffered index */
+    const char* xb = v->inner == INNER_ROWS ? "ii" : "jj";
+    const char* yb = v->inner == INNER_ROWS ? "jj" : "ii";
+    int xs = v->inner == INNER_ROWS ? v->bh : v->bw;
+    int ys = v->inner == INNER_ROWS ? v->bw : v->bh;
+    const char* xn = v->inner == INNER_ROWS ? "N" : "M";
+    const char* yn = v->inner == INNER_ROWS ? "M" : "N";
+    int k;
+
+    fprintf(fp, "/*\n * transpose_tuned - %dx%d blocks (rows x columns of A), %s, %s inside,\n"
+            " *     depth %d; %ld misses at M=%d N=%d s=%d E=%d b=%d\n */\n",
+            v->bh, v->bw, outer_names[v->outer], inner_names[v->inner], v->depth,
+            v->misses, M, N, s, E, b);
+    fprintf(fp, "char transpose_tuned_desc[] = \"Tuned %dx%d %s %s depth %d\";\n",
+            v->bh, v->bw, outer_names[v->outer], inner_names[v->inner], v->depth);
+    fprintf(fp, "void transpose_tuned(int M, int N, int A[N][M], int B[M][N])\n{\n");
+    fprintf(fp, "    int ii, jj, i, j");
+    for (k = 0; k < v->depth && v->depth > 1; k++)
+        fprintf(fp, ", a%d", k);
+    fprintf(fp, ";\n\n");
+
+    fprintf(fp, "    for (%s = 0; %s < %s; %s += %d) {\n", ii, ii,
+            ii[0] == 'i' ? "N" : "M", ii, ii[0] == 'i' ? v->bh : v->bw);
+    fprintf(fp, "        for (%s = 0; %s < %s; %s += %d) {\n", jj, jj,
+            jj[0] == 'i' ? "N" : "M", jj, jj[0] == 'i' ? v->bh : v->bw);
+    fprintf(fp, "            for (%s = %s; %s < %s + %d && %s < %s; %s++) {\n",
+            x, xb, x, xb, xs, x, xn, x);
+    if (v->depth > 1) {
+        fprintf(fp, "                for (%s = %s; %s + %d <= %s + %d && %s + %d <= %s; %s += %d) {\n",
+                y, yb, y, v->depth, yb, ys, y, v->depth, yn, y, v->depth);
+        for (k = 0; k < v->depth; k++) {
+            if (k == 0)
+                fprintf(fp, "                    a0 = A[i][j];\n");
+            else if (v->inner == INNER_ROWS)
+                fprintf(fp, "                    a%d = A[i][j + %d];\n", k, k);
+            else
+                fprintf(fp, "                    a%d = A[i + %d][j];\n", k, k);
+        }
+        for (k = 0; k < v->depth; k++) {
+            if (k == 0)
+                fprintf(fp, "                    B[j][i] = a0;\n");
+            else if (v->inner == INNER_ROWS)
+                fprintf(fp, "                    B[j + %d][i] = a%d;\n", k, k);
+            else
+                fprintf(fp, "                    B[j][i + %d] = a%d;\n", k, k);
+        }
+        fprintf(fp, "                }\n");
+        fprintf(fp, "                for (; %s < %s + %d && %s < %s; %s++)\n",
+                y, yb, ys, y, yn, y);
+    }
+    else {
+        fprintf(fp, "                for (%s = %s; %s < %s + %d && %s < %s; %s++)\n",
+                y, yb, y, yb, ys, y, yn, y);
+    }
+    fprintf(fp, "                    B[j][i] = A[i][j];\n");
+    fprintf(fp, "            }\n        }\n    }\n}\n");
+}
+
+/*
+ * read_regions - Take the addresses of A and B from a .regions file
+ */
+static int read_regions(const char* name)
+{
+    FILE* fp = fopen(name, "r");
+    char which;
+    unsigned long lo, hi;
+    int found = 0;
+
+    if (fp == NULL) {
+        perror(name);
+        return 0;
+    }
+    while (fscanf(fp, " %c %lx %lx", &which, &lo, &hi) == 3) {
+        if (which == 'A') {
+            abase = lo;
+            found |= 1;
+        }
+        else if (which == 'B') {
+            bbase = lo;
+            found |= 2;
+        }
+    }
+    fclose(fp);
+    if (found != 3)
+        fprintf(stderr, "%s: no A and B regions\n", name);
+    return found == 3;
+}
+
+static void usage(char* argv[])
+{
+    printf("Usage: %s [-h] -M <M> -N <N> [-s <s>] [-E <E>] [-b <b>] [-p <policy>]\n"
+           "       [-k <count>] [-o <file>] [-r <regions>]\n", argv[0]);
+    printf("Options:\n");
+    printf("  -h          Print this help message.\n");
+    printf("  -M <M>      M as given to test-trans, the columns of A (max %d).\n", MAXN);
+    printf("  -N <N>      N as given to test-trans, the rows of A (max %d).\n", MAXN);
+    printf("  -s <s>      Number of set index bits (default 5).\n");
+    printf("  -E <E>      Associativity (default 1).\n");
+    printf("  -b <b>      Number of block bits (default 5).\n");
+    printf("  -p <policy> Replacement policy (default lru): %s.\n", cache_policy_names);
+    printf("  -k <count>  Variants to list (default 10).\n");
+    printf("  -o <file>   Write the best variant there instead of to stdout.\n");
+    printf("  -r <file>   Lay A and B out as in this .regions file from tracegen\n");
+    printf("              (default: page aligned, exact only while s + b <= 12).\n");
+    printf("Example: %s -M 61 -N 67\n", argv[0]);
+}
+
+int main(int argc, char* argv[])
+{
+    int s = 5, E = 1, b = 5, top = 10;
+    char* policy = "lru";
+    char* outname = NULL;
+    int hs[32], ws[32], nh, nw;
+    variant_t* list;
+    variant_t v;
+    long n = 0, skipped = 0, pruned = 0;
+    int c;
+
+    while ((c = getopt(argc, argv, "M:N:s:E:b:p:k:o:r:h")) != -1) {
+        switch (c) {
+        case 'M':
+            M = atoi(optarg);
+            break;
+        case 'N':
+            N = atoi(optarg);
+            break;
+        case 's':
+            s = atoi(optarg);
+            break;
+        case 'E':
+            E = atoi(optarg);
+            break;
+        case 'b':
+            b = atoi(optarg);
+            break;
+        case 'p':
+            policy = optarg;
+            break;
+        case 'k':
+            top = atoi(optarg);
+            break;
+        case 'o':
+            outname = optarg;
+            break;
+        case 'r':
+            if (!read_regions(optarg))
+                exit(1);
+            break;
+        case 'h':
+            usage(argv);
+            exit(0);
+        default:
+            usage(argv);
+            exit(1);
+        }
+    }
+    if (M <= 0 || N <= 0 || M > MAXN || N > MAXN || top < 1) {
+        usage(argv);
+        exit(1);
+    }
+
+    nh = sizes(N, hs);
+    nw = sizes(M, ws);
+    list = calloc((size_t)nh * nw * 2 * 2 * 4, sizeof(variant_t));
+    if (list == NULL) {
+        fprintf(stderr, "calloc error.\n");
+        exit(1);
+    }
+
+    // 先按深度从大到小试, 好的结果早出现, 上界收得快
+    for (int depth = MAXDEPTH; depth >= 1; depth /= 2) {
+        for (int h = 0; h < nh; h++) {
+            for (int w = 0; w < nw; w++) {
+                for (int outer = 0; outer < 2; outer++) {
+                    for (int inner = 0; inner < 2; inner++) {
+                        long bound = n >= top ? list[top - 1].misses : (long)M * N * 2;
+                        v.bh = hs[h];
+                        v.bw = ws[w];
+                        v.outer = outer;
+                        v.inner = inner;
+                        v.depth = depth;
+                        if (redundant(&v)) {
+                            skipped++;
+                            continue;
+                        }
+                        if (!simulate(&v, s, E, b, policy, bound)) {
+                            pruned++;
+                            continue;
+                        }
+                        // 插入排序, 按缺失数保持有序
+                        long k = n++;
+                        for (; k > 0 && list[k - 1].misses > v.misses; k--)
+                            list[k] = list[k - 1];
+                        list[k] = v;
+                    }
+                }
+            }
+        }
+    }
+
+    printf("M=%d N=%d s=%d E=%d b=%d policy=%s\n", M, N, s, E, b, policy);
+    printf("variants:%ld skipped:%ld pruned:%ld simulated:%ld\n",
+           n + skipped + pruned, skipped, pruned, n);
+    printf("%8s %8s %5s %5s %-10s %-5s %5s\n", "misses", "hits", "rows", "cols",
+           "blocks", "inner", "depth");
+    for (long k = 0; k < n && k < top; k++) {
+        variant_t* p = &list[k];
+        printf("%8ld %8ld %5d %5d %-10s %-5s %5d\n", p->misses, p->hits, p->bh, p->bw,
+               outer_names[p->outer], inner_names[p->inner], p->depth);
+    }
+
+    if (outname != NULL) {
+        FILE* fp = fopen(outname, "w");
+        if (fp == NULL) {
+            perror(outname);
+            exit(1);
+        }
+        emit(fp, &list[0], s, E, b);
+        fclose(fp);
+    }
+    else {
+        printf("\n");
+        emit(stdout, &list[0], s, E, b);
+    }
+    free(list);
+    return 0;
+}